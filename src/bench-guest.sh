@@ -0,0 +1,120 @@
+#!/bin/sh
+# bench-guest.sh: /init of the bench.sh guest, see there
+
+/bin/busybox --install -s /bin
+mount -t proc proc /proc
+mount -t sysfs sysfs /sys
+mount -t devtmpfs devtmpfs /dev
+mkdir -p /run /tmp
+. /bench.conf
+
+mark()
+{
+	echo "@@bench $*"
+}
+
+die()
+{
+	mark error "$*"
+	poweroff -f
+}
+
+# interrupts of both NICs, summed over all CPUs
+irqs()
+{
+	awk -v a="$a" -v b="$b" '$0 ~ a || $0 ~ b {
+		for (i = 2; i <= NF && $i ~ /^[0-9]+$/; i++)
+			s += $i
+	} END { print s + 0 }' /proc/interrupts
+}
+
+now()
+{
+	cut -d ' ' -f 1 /proc/uptime
+}
+
+# run <test> <command...>: reports the interrupt rate along the way
+run()
+{
+	name=$1
+	shift
+	i0=$(irqs)
+	t0=$(now)
+	mark begin "$name"
+	"$@"
+	mark end "$name"
+	mark result "$name" irqs_per_sec "$(echo "$i0 $(irqs) $t0 $(now)" |
+		awk '{ printf "%d", ($2 - $1) / ($4 - $3) }')"
+}
+
+pg()
+{
+	echo "$2" > "/proc/net/pktgen/$1"
+}
+
+pktgen()
+{
+	[ -d /proc/net/pktgen ] || die "no pktgen in the guest kernel"
+	pg kpktgend_0 "rem_device_all"
+	pg kpktgend_0 "add_device $a"
+	pg "$a" "count $BENCH_PKTS"
+	pg "$a" "pkt_size 60"
+	pg "$a" "delay 0"
+	pg "$a" "dst 10.0.0.2"
+	pg "$a" "dst_mac $(ip netns exec peer cat /sys/class/net/$b/address)"
+	pg pgctrl start
+	res=$(cat "/proc/net/pktgen/$a")
+	mark result pktgen pps "$(echo "$res" | sed -n 's/.* \([0-9]*\)pps.*/\1/p')"
+	mark result pktgen mbps \
+		"$(echo "$res" | sed -n 's/.*pps \([0-9]*\)Mb\/sec.*/\1/p')"
+}
+
+tcp()
+{
+	ip netns exec peer iperf3 -s -D -1
+	sleep 1
+	mark result tcp mbps "$(iperf3 -c 10.0.0.2 -t "$BENCH_SECS" -f m |
+		awk '/receiver/ { print $(NF - 2) }')"
+}
+
+# percentile <p>: of the sorted values on stdin
+percentile()
+{
+	awk -v p="$1" '{ v[NR] = $1 } END {
+		if (NR) printf "%d", v[int((NR - 1) * p) + 1] * 1000
+	}'
+}
+
+latency()
+{
+	ping -c "$BENCH_PINGS" -i 0.01 10.0.0.2 |
+		sed -n 's/.*time=\([0-9.]*\) ms.*/\1/p' | sort -n > /tmp/rtt
+	mark result latency p50_us "$(percentile 0.5 < /tmp/rtt)"
+	mark result latency p99_us "$(percentile 0.99 < /tmp/rtt)"
+}
+
+insmod /pcnet.ko || die "insmod pcnet.ko failed"
+set --
+for n in /sys/class/net/*; do
+	drv=$(readlink "$n/device/driver")
+	[ "${drv##*/}" = pcnet_dummy ] && set -- "$@" "${n##*/}"
+done
+[ $# -eq 2 ] || die "expected two pcnet_dummy interfaces, found $#"
+a=$1
+b=$2
+
+ip link set lo up
+ip netns add peer
+ip link set "$b" netns peer
+ip netns exec peer ip link set lo up
+ip netns exec peer ip addr add 10.0.0.2/24 dev "$b"
+ip netns exec peer ip link set "$b" up
+ip addr add 10.0.0.1/24 dev "$a"
+ip link set "$a" up
+sleep 2
+
+run pktgen pktgen
+run tcp tcp
+run latency latency
+
+poweroff -f
@@ -0,0 +1,135 @@
+#!/bin/sh
+# bench.sh: throughput and latency benchmark of pcnet.ko under QEMU
+#
+# Boots the kernel of $KERNELDIR with two PCnet NICs on one QEMU hub, so
+# no host or external network is involved. The guest loads pcnet.ko,
+# moves the second NIC into a network namespace and runs pktgen, bulk
+# TCP (iperf3) and ping latency from the first NIC to the second one.
+# Results are written to $BENCH_OUT as JSON, one file per commit.
+#
+# The guest kernel needs CONFIG_NET_PKTGEN=y, CONFIG_NET_NS=y and
+# CONFIG_DEVTMPFS=y and must not have pcnet32 built in. busybox, ip and
+# iperf3 are copied from the host together with their libraries.
+# VM exits are read from the host's KVM debugfs and include every VM
+# running at the same time.
+
+set -e
+
+KERNELDIR=${KERNELDIR:-/lib/modules/$(uname -r)/build}
+BENCH_KERNEL=${BENCH_KERNEL:-$KERNELDIR/arch/x86/boot/bzImage}
+commit=$(git describe --always --dirty 2>/dev/null || echo unknown)
+BENCH_OUT=${BENCH_OUT:-bench-$commit.json}
+BENCH_SECS=${BENCH_SECS:-10}
+BENCH_PINGS=${BENCH_PINGS:-1000}
+BENCH_PKTS=${BENCH_PKTS:-1000000}
+QEMU=${QEMU:-qemu-system-x86_64}
+BUSYBOX=${BUSYBOX:-$(command -v busybox)}
+IP=${IP:-$(command -v ip)}
+IPERF3=${IPERF3:-$(command -v iperf3)}
+KVM_EXITS=/sys/kernel/debug/kvm/exits
+
+for f in "$BENCH_KERNEL" pcnet.ko bench-guest.sh "$BUSYBOX" "$IP" \
+		"$IPERF3"; do
+	if [ ! -f "$f" ]; then
+		echo "bench.sh: missing ${f:-busybox, ip or iperf3}" >&2
+		exit 1
+	fi
+done
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+root=$dir/root
+
+# copies a host binary and the shared libraries it needs
+copy_bin()
+{
+	cp "$1" "$root/bin/"
+	ldd "$1" 2>/dev/null | awk '/\// { print $(NF - 1) }' |
+	while read -r lib; do
+		mkdir -p "$root$(dirname "$lib")"
+		cp -L "$lib" "$root$lib"
+	done
+}
+
+mkdir -p "$root/bin" "$root/proc" "$root/sys" "$root/dev"
+copy_bin "$BUSYBOX"
+copy_bin "$IP"
+copy_bin "$IPERF3"
+ln -s busybox "$root/bin/sh"
+cp pcnet.ko "$root/"
+cp bench-guest.sh "$root/init"
+chmod +x "$root/init"
+cat > "$root/bench.conf" <<EOF
+BENCH_SECS=$BENCH_SECS
+BENCH_PINGS=$BENCH_PINGS
+BENCH_PKTS=$BENCH_PKTS
+EOF
+(cd "$root" && find . | cpio -o -H newc 2>/dev/null | gzip) > "$dir/initrd.gz"
+
+exits()
+{
+	cat "$KVM_EXITS" 2>/dev/null || true
+}
+
+# The guest reports on the console with lines of the form
+#   @@bench begin|end <test>
+#   @@bench result <test> <key> <value>
+#   @@bench error <message>
+# The host adds the VM exit rate of every test.
+"$QEMU" -machine accel=kvm:tcg -m 512 -smp 1 -nographic -no-reboot \
+	-kernel "$BENCH_KERNEL" -initrd "$dir/initrd.gz" \
+	-append "console=ttyS0 quiet panic=-1" \
+	-netdev hubport,id=n0,hubid=0 -device pcnet,netdev=n0 \
+	-netdev hubport,id=n1,hubid=0 -device pcnet,netdev=n1 |
+tr -d '\r' |
+while read -r tag ev name key val; do
+	[ "$tag" = "@@bench" ] || continue
+	case $ev in
+	begin)
+		e0=$(exits)
+		t0=$(date +%s.%N)
+		;;
+	end)
+		e1=$(exits)
+		t1=$(date +%s.%N)
+		if [ -n "$e0" ] && [ -n "$e1" ]; then
+			echo "$name vm_exits_per_sec" \
+				"$(echo "$e0 $e1 $t0 $t1" |
+				awk '{ printf "%d", ($2 - $1) / ($4 - $3) }')"
+		fi
+		;;
+	result)
+		echo "$name $key $val"
+		;;
+	error)
+		echo "bench.sh: guest: $name $key $val" >&2
+		echo "error"
+		;;
+	esac
+done > "$dir/results"
+
+if grep -q '^error$' "$dir/results"; then
+	exit 1
+fi
+
+awk -v commit="$commit" -v kernel="$(basename "$BENCH_KERNEL")" '
+	{
+		if (!($1 in seen)) {
+			seen[$1] = 1
+			tests[++n] = $1
+		}
+		keys[$1] = keys[$1] sprintf("%s\"%s\": %s",
+				keys[$1] == "" ? "" : ", ", $2,
+				$3 == "" ? "null" : $3)
+	}
+	END {
+		printf "{\n  \"commit\": \"%s\",\n  \"kernel\": \"%s\",\n", \
+				commit, kernel
+		printf "  \"results\": {\n"
+		for (i = 1; i <= n; i++)
+			printf "    \"%s\": { %s }%s\n", tests[i], keys[tests[i]], \
+					i < n ? "," : ""
+		printf "  }\n}\n"
+	}' "$dir/results" > "$BENCH_OUT"
+
+echo "bench.sh: results written to $BENCH_OUT"
@@ -13,9 +13,30 @@
 #include <linux/etherdevice.h>
 #include <linux/spinlock.h>
 #include <linux/types.h>
+#include <linux/skbuff.h>
+#include <linux/interrupt.h>
+#include <linux/dma-mapping.h>
+#include <linux/delay.h>
+#include <linux/mm.h>
+#include <linux/ethtool.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/jump_label.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/hrtimer.h>
+#include <linux/log2.h>
+#include <linux/slab.h>
+#include <linux/crc32.h>
+#include <linux/rtnetlink.h>
+#include <linux/percpu.h>
+#include <linux/u64_stats_sync.h>
 
 #include "pcnet.h"
 
+#define CREATE_TRACE_POINTS
+#include "pcnet_trace.h"
+
 #define DRV_NAME	"pcnet_dummy"
 #define DRV_VERSION	"dev"
 #define DRV_DESCRIPTION	"PCNet-PCI II/III Ethernet controller driver"
@@ -26,6 +47,38 @@ MODULE_DESCRIPTION(DRV_DESCRIPTION);
 MODULE_VERSION(DRV_VERSION);
 MODULE_LICENSE("GPL");
 
+/* Enabled while at least one controller runs in word I/O mode, so
+ * that with dword-only hardware the accessors carry no mode test.
+ */
+static struct static_key pcnet_wio_key = STATIC_KEY_INIT_FALSE;
+
+/* Enabled while latency histograms are collected on any controller */
+static struct static_key pcnet_hist_key = STATIC_KEY_INIT_FALSE;
+
+/* Memory mapped registers (BAR 1) are much cheaper to access than
+ * ports, in particular under virtualization. Port I/O (BAR 0) is used
+ * if disabled or the controller has no memory BAR.
+ */
+#ifdef USE_IO_OPS
+static bool use_mmio;
+#else
+static bool use_mmio = true;
+#endif
+module_param(use_mmio, bool, S_IRUGO);
+MODULE_PARM_DESC(use_mmio, "Prefer memory mapped registers over port I/O");
+
+/* frames shorter than this are copied, larger ones are passed up as is */
+static unsigned int rx_copybreak = 256;
+module_param(rx_copybreak, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(rx_copybreak, "Maximum size of a copied RX frame");
+
+/* frames shorter than this are copied to the TX bounce area rather
+ * than mapped, up to PCNET_TX_BOUNCE_LEN
+ */
+static unsigned int tx_copybreak = 256;
+module_param(tx_copybreak, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(tx_copybreak, "Maximum size of a copied TX frame");
+
 static DEFINE_PCI_DEVICE_TABLE(pcnet_dummy_pci_tbl) = {
 	{ PCI_DEVICE(PCI_VENDOR_ID_AMD, PCI_DEVICE_ID_AMD_LANCE) },
 	{ }
@@ -83,107 +136,1758 @@ struct xmit_descr {
 	__le32 reserved;
 };
 
-struct pcnet_private {
-	/* TODO:
-	 * DMA buffer management operations
+/* Software state of a TX descriptor. A frame may span several
+ * descriptors, the skb and the frame length are kept in the last one
+ * (ENP).
+ */
+struct pcnet_buffer {
+	struct sk_buff *skb;
+	dma_addr_t dma;
+	unsigned int len;
+	unsigned int bytes;
+	/* time the frame was posted, with histograms enabled */
+	ktime_t stamp;
+	/* mapped with skb_frag_dma_map() rather than dma_map_single() */
+	bool frag;
+	/* copied to the bounce slot of the descriptor, nothing mapped */
+	bool bounce;
+};
+
+/* descriptors needed by the largest frame */
+#define PCNET_TX_DESC_MAX	(MAX_SKB_FRAGS + 1)
+
+/* An RX descriptor owns a page that stays mapped for its whole life.
+ * Frames are received into one half of it, the other half is used
+ * once the stack has released it. Each half is laid out for
+ * build_skb(): headroom in front of the frame, skb_shared_info behind.
+ */
+#define PCNET_RX_HEADROOM	(NET_SKB_PAD + NET_IP_ALIGN)
+#define PCNET_RX_TRUESIZE	(PAGE_SIZE / 2)
+
+struct pcnet_rx_buffer {
+	struct page *page;
+	dma_addr_t dma;
+	unsigned int offset;
+};
+
+struct pcnet_rx_ring {
+	struct xmit_descr *desc;
+	dma_addr_t dma;
+	struct pcnet_rx_buffer *buf;
+	/* number of descriptors, a power of two */
+	unsigned int size;
+	/* next descriptor to be checked for a received frame */
+	unsigned int cur;
+};
+
+struct pcnet_tx_ring {
+	struct xmit_descr *desc;
+	dma_addr_t dma;
+	struct pcnet_buffer *buf;
+	/* PCNET_TX_BOUNCE_LEN bytes per descriptor, mapped for the life
+	 * of the ring
 	 */
-	spinlock_t lock;
+	void *bounce;
+	dma_addr_t bounce_dma;
+	/* number of descriptors, a power of two */
+	unsigned int size;
+	/* free running counters: next descriptor to fill / to reclaim */
+	unsigned int cur;
+	unsigned int dirty;
+};
+
+/* TINT is unmasked above the high and masked below the low mark */
+#define PCNET_TX_HIWAT(pp)	((pp)->tx.size * 3 / 4)
+#define PCNET_TX_LOWAT(pp)	((pp)->tx.size / 4)
+
+/* log2 histogram, bucket n counts values in [2^(n-1), 2^n) us */
+struct pcnet_hist {
+	u64 bucket[PCNET_HIST_BUCKETS];
+};
+
+enum {
+	PCNET_SHADOW_CSR3,
+	PCNET_SHADOW_CSR15,
+	PCNET_SHADOW_BCR20,
+	PCNET_SHADOW_NR,
+};
+
+#define PCNET_RAP_UNKNOWN	(~0U)
+
+/* register access state and statistics */
+struct pcnet_regs {
+	/* register currently selected by RAP */
+	u32 rap;
+	u16 shadow[PCNET_SHADOW_NR];
+	unsigned long shadow_valid;
+
+	u64 reads;
+	u64 writes;
+	u64 rap_writes;
+	u64 rap_skips;
+	u64 shadow_hits;
+};
+
+/* per-CPU datapath counters, errors are rare and go to ndev->stats */
+struct pcnet_stats {
+	u64 rx_packets;
+	u64 rx_bytes;
+	u64 tx_packets;
+	u64 tx_bytes;
+	struct u64_stats_sync syncp;
+};
+
+/* Fields are grouped by how they are written: cold setup state, state
+ * written under the lock by start_xmit, the ISR and the NAPI reclaim and
+ * re-arm, and RX state only written by NAPI without the lock. Each hot
+ * group starts on a cache line of its own.
+ */
+struct pcnet_private {
 	struct pci_dev *pci_dev;
+	struct net_device *ndev;
 	void __iomem *base;
+	/* controller is in 32-bit I/O mode (BCR18 DWIO) */
+	bool dwio;
+	/* registers are accessed through the memory BAR */
+	bool mmio;
+
+	struct pcnet_dummy_init_block *init_block;
+	dma_addr_t init_block_dma;
+	struct pcnet_stats __percpu *stats;
+
+	/* The timer reclaims the tail of a burst while TINT is masked */
+	struct timer_list tx_timer;
+	/* Interrupt moderation: after a busy poll RINT/TINT stay masked in
+	 * CSR3 for itr_usecs, the hrtimer unmasks them again.
+	 */
+	struct hrtimer itr_timer;
+	/* ethtool -C */
+	unsigned int rx_usecs;
+	bool adaptive_rx;
+	/* logical address filter in CSR8-CSR11 order */
+	u16 mc_filter[4];
+	/* ethtool -G, applied on the next ring allocation */
+	unsigned int rx_pending;
+	unsigned int tx_pending;
+
+	struct dentry *debugfs;
+	/* latency histograms are collected */
+	bool hist_on;
+
+	/* protects register access, the TX ring and the interrupt masks */
+	spinlock_t lock ____cacheline_aligned_in_smp;
+	struct pcnet_regs regs;
+	/* IENA as last written to CSR0, lets TDMD be raised without
+	 * reading CSR0 back
+	 */
+	u16 iena;
+	/* TINT is masked while the TX ring is below the high watermark
+	 * and the queue is running, completed descriptors are reclaimed
+	 * from start_xmit and the NAPI poll then.
+	 */
+	bool tx_tint;
+	bool itr_holdoff;
+	unsigned int itr_usecs;
+	/* RX interrupt time, start of the RX dwell estimate */
+	ktime_t rx_stamp;
+	struct pcnet_tx_ring tx;
+	/* TX post to reclaim time */
+	struct pcnet_hist tx_hist;
+
+	struct napi_struct napi ____cacheline_aligned_in_smp;
+	struct pcnet_rx_ring rx;
+	/* RX pages reused for the next frame vs. replaced by a new one */
+	u64 rx_pages_recycled;
+	u64 rx_pages_alloc;
+	/* RX dwell estimate, the time from the RX interrupt until a frame
+	 * is handled
+	 */
+	struct pcnet_hist rx_hist;
 };
 
 /* 16 most significant bits of all registers are undefined on reading and 
  * must be set to 0 on writing (except of CSR88)
  */
 
-#define read_csr(csr) pcnet_dummy_read_csr(pp->base, csr)
-#define read_bcr(bcr) pcnet_dummy_read_bcr(pp->base, bcr)
-#define write_csr(csr, val) pcnet_dummy_write_csr(pp->base, csr, val)
-#define write_bcr(bcr, val) pcnet_dummy_write_bcr(pp->base, bcr, val)
+#define read_csr(csr) pcnet_dummy_read_csr(pp, csr)
+#define read_bcr(bcr) pcnet_dummy_read_bcr(pp, bcr)
+#define write_csr(csr, val) pcnet_dummy_write_csr(pp, csr, val)
+#define write_bcr(bcr, val) pcnet_dummy_write_bcr(pp, bcr, val)
+
+/* Word and dword I/O modes differ in port offsets and access width
+ * only. Both are inlined into every accessor, the word mode branch is
+ * patched out by the static key unless such a controller is present.
+ */
+static inline bool pcnet_dummy_wio(struct pcnet_private *pp)
+{
+	return static_key_false(&pcnet_wio_key) && !pp->dwio;
+}
+
+static inline u32 pcnet_dummy_in(struct pcnet_private *pp,
+		unsigned int port, unsigned int port16)
+{
+	if (pcnet_dummy_wio(pp))
+		return ioread16(pp->base + port16);
+	return ioread32(pp->base + port);
+}
+
+static inline void pcnet_dummy_out(struct pcnet_private *pp,
+		unsigned int port, unsigned int port16, u32 val)
+{
+	if (pcnet_dummy_wio(pp))
+		iowrite16(val, pp->base + port16);
+	else
+		iowrite32(val, pp->base + port);
+}
+
+/* Every access goes through RAP, which keeps its value between
+ * accesses. It is written only when a different register is selected.
+ * Callers hold pp->lock, so the tracked value can't go stale.
+ */
+static inline void pcnet_dummy_set_rap(struct pcnet_private *pp, u32 reg)
+{
+	if (pp->regs.rap == reg) {
+		pp->regs.rap_skips++;
+		return;
+	}
+	pcnet_dummy_out(pp, PCNET_RAP, PCNET_RAP16, reg);
+	pp->regs.rap = reg;
+	pp->regs.rap_writes++;
+}
+
+/* Registers only the driver changes are served from a shadow copy.
+ * Registers are passed as constants, so the lookup folds away.
+ */
+static inline int pcnet_dummy_csr_shadow(u32 csr)
+{
+	switch (csr) {
+	case CSR3:
+		return PCNET_SHADOW_CSR3;
+	case CSR15:
+		return PCNET_SHADOW_CSR15;
+	default:
+		return -1;
+	}
+}
+
+static inline int pcnet_dummy_bcr_shadow(u32 bcr)
+{
+	switch (bcr) {
+	case BCR20:
+		return PCNET_SHADOW_BCR20;
+	default:
+		return -1;
+	}
+}
+
+static inline u32 pcnet_dummy_read_reg(struct pcnet_private *pp, u32 reg,
+		unsigned int port, unsigned int port16, int shadow)
+{
+	u32 val;
+
+	if (shadow >= 0 && test_bit(shadow, &pp->regs.shadow_valid)) {
+		pp->regs.shadow_hits++;
+		return pp->regs.shadow[shadow];
+	}
+	pcnet_dummy_set_rap(pp, reg);
+	val = pcnet_dummy_in(pp, port, port16) & 0xffff;
+	pp->regs.reads++;
+	if (shadow >= 0) {
+		pp->regs.shadow[shadow] = val;
+		__set_bit(shadow, &pp->regs.shadow_valid);
+	}
+
+	return val;
+}
+
+static inline void pcnet_dummy_write_reg(struct pcnet_private *pp, u32 reg,
+		unsigned int port, unsigned int port16, int shadow, u32 val)
+{
+	pcnet_dummy_set_rap(pp, reg);
+	pcnet_dummy_out(pp, port, port16, val & 0xffff);
+	pp->regs.writes++;
+	if (shadow >= 0) {
+		pp->regs.shadow[shadow] = val & 0xffff;
+		__set_bit(shadow, &pp->regs.shadow_valid);
+	}
+}
 
-static inline u32 pcnet_dummy_read_csr(void __iomem *ioaddr, u32 csr)
+static inline u32 pcnet_dummy_read_csr(struct pcnet_private *pp, u32 csr)
 {
-	iowrite32(csr, ioaddr + PCNET_RAP);
-	return ioread32(ioaddr + PCNET_RDP) & 0xffff;
+	return pcnet_dummy_read_reg(pp, csr, PCNET_RDP, PCNET_RDP16,
+			pcnet_dummy_csr_shadow(csr));
 }
 
-static inline u32 pcnet_dummy_read_bcr(void __iomem *ioaddr, u32 bcr)
+static inline u32 pcnet_dummy_read_bcr(struct pcnet_private *pp, u32 bcr)
 {
-	iowrite32(bcr, ioaddr + PCNET_RAP);
-	return ioread32(ioaddr + PCNET_BDP) & 0xffff;
+	return pcnet_dummy_read_reg(pp, bcr, PCNET_BDP, PCNET_BDP16,
+			pcnet_dummy_bcr_shadow(bcr));
 }
 
-static inline void pcnet_dummy_write_csr(void __iomem *ioaddr, u32 csr, u32 val)
+static inline void pcnet_dummy_write_csr(struct pcnet_private *pp, u32 csr,
+		u32 val)
 {
-	iowrite32(csr, ioaddr + PCNET_RAP);
-	iowrite32(val & 0xffff, ioaddr + PCNET_RDP);
+	pcnet_dummy_write_reg(pp, csr, PCNET_RDP, PCNET_RDP16,
+			pcnet_dummy_csr_shadow(csr), val);
 }
 
-static inline void pcnet_dummy_write_bcr(void __iomem *ioaddr, u32 bcr, u32 val)
+static inline void pcnet_dummy_write_bcr(struct pcnet_private *pp, u32 bcr,
+		u32 val)
 {
-	iowrite32(bcr, ioaddr + PCNET_RAP);
-	iowrite32(val & 0xffff, ioaddr + PCNET_BDP);
+	pcnet_dummy_write_reg(pp, bcr, PCNET_BDP, PCNET_BDP16,
+			pcnet_dummy_bcr_shadow(bcr), val);
 }
 
-static int pcnet_dummy_reset(void __iomem *ioaddr)
+/* forget RAP and the shadow copies, the chip has been reset */
+static inline void pcnet_dummy_regs_invalidate(struct pcnet_private *pp)
 {
+	pp->regs.rap = PCNET_RAP_UNKNOWN;
+	pp->regs.shadow_valid = 0;
+}
+
+/* S_RESET in the I/O mode found at probe time, the mode is kept */
+static int pcnet_dummy_reset(struct pcnet_private *pp)
+{
+	pcnet_dummy_regs_invalidate(pp);
+	pcnet_dummy_in(pp, PCNET_RESET, PCNET_RESET16);
+	if (read_csr(CSR0) != CSR0_STOP)
+		return -EBUSY;
+
+	return 0;
+}
+
+/* Resets the controller and finds out its I/O mode. A controller in
+ * word mode is switched to dword mode; if it refuses, it stays in word
+ * mode and the word mode accessors are enabled.
+ */
+static int __devinit pcnet_dummy_detect_io_mode(struct pcnet_private *pp)
+{
+	void __iomem *ioaddr = pp->base;
+
+	pcnet_dummy_regs_invalidate(pp);
+	pp->dwio = true;
 	ioread16(ioaddr + PCNET_RESET16);
-	/* helper functions for WORD I/O mode ain't implemented */
 	iowrite16(CSR0, ioaddr + PCNET_RAP16);
-	if (ioread16(ioaddr + PCNET_RDP16) == CSR0_STOP)
+	if (ioread16(ioaddr + PCNET_RDP16) == CSR0_STOP) {
+		/* a dword write to RDP sets controller into 32-bit I/O mode */
+		iowrite32(0, ioaddr + PCNET_RDP);
+		if (read_bcr(BCR18) & BCR18_DWIO)
+			return 0;
+		/* the word accessors need the key for the reset already */
+		static_key_slow_inc(&pcnet_wio_key);
+		pp->dwio = false;
+		pcnet_dummy_regs_invalidate(pp);
+		if (pcnet_dummy_reset(pp)) {
+			static_key_slow_dec(&pcnet_wio_key);
+			return -ENODEV;
+		}
 		return 0;
+	}
 	/* try to reset for DWORD I/O mode */
 	ioread32(ioaddr + PCNET_RESET);
-	if (pcnet_dummy_read_csr(ioaddr, CSR0) != CSR0_STOP)
-		return -EBUSY;
+	if (read_csr(CSR0) != CSR0_STOP)
+		return -ENODEV;
 
 	return 0;
 }
 
-static int pcnet_dummy_switch_dword_mode(void __iomem *ioaddr)
+static inline unsigned int pcnet_dummy_tx_avail(struct pcnet_private *pp)
 {
-	/* a dword write to RDP sets controller into 32-bit I/O mode */
-	iowrite32(0, ioaddr + PCNET_RDP);
-	return !(pcnet_dummy_read_bcr(ioaddr, BCR18) & BCR18_DWIO);
+	return pp->tx.size - (pp->tx.cur - pp->tx.dirty);
+}
+
+static inline bool pcnet_dummy_hist_on(struct pcnet_private *pp)
+{
+	return static_key_false(&pcnet_hist_key) && pp->hist_on;
+}
+
+static void pcnet_dummy_hist_add(struct pcnet_hist *h, ktime_t from,
+		ktime_t to)
+{
+	s64 us = ktime_us_delta(to, from);
+
+	h->bucket[us > 0 ? min(fls64(us), PCNET_HIST_BUCKETS - 1) : 0]++;
+}
+
+/* Descriptor fields other than the status word must be visible to the
+ * controller before OWN is handed over, hence the barrier.
+ */
+static inline void pcnet_dummy_give_descr(struct xmit_descr *d,
+		dma_addr_t dma, unsigned int len, u16 status)
+{
+	d->addr = cpu_to_le32(dma);
+	d->size = cpu_to_le16(DESC_BCNT_ONES | (-len & 0x0fff));
+	d->flags = 0;
+	wmb();
+	d->status = cpu_to_le16(DESC_OWN | status);
+}
+
+static int pcnet_dummy_alloc_rx_page(struct pcnet_private *pp,
+		struct pcnet_rx_buffer *rb, gfp_t gfp)
+{
+	struct page *page;
+	dma_addr_t dma;
+
+	page = alloc_page(gfp | __GFP_COLD);
+	if (!page)
+		return -ENOMEM;
+	dma = dma_map_page(&pp->pci_dev->dev, page, 0, PAGE_SIZE,
+			DMA_FROM_DEVICE);
+	if (dma_mapping_error(&pp->pci_dev->dev, dma)) {
+		__free_page(page);
+		return -ENOMEM;
+	}
+	rb->page = page;
+	rb->dma = dma;
+	rb->offset = 0;
+
+	return 0;
+}
+
+static void pcnet_dummy_unmap_tx(struct pcnet_private *pp,
+		struct pcnet_buffer *buf)
+{
+	if (buf->frag)
+		dma_unmap_page(&pp->pci_dev->dev, buf->dma, buf->len,
+				DMA_TO_DEVICE);
+	else if (!buf->bounce)
+		dma_unmap_single(&pp->pci_dev->dev, buf->dma, buf->len,
+				DMA_TO_DEVICE);
+	buf->len = 0;
+}
+
+static void pcnet_dummy_free_rx_ring(struct pcnet_private *pp,
+		struct pcnet_rx_ring *rx)
+{
+	struct device *dev = &pp->pci_dev->dev;
+	struct pcnet_rx_buffer *rb;
+	unsigned int i;
+
+	if (rx->buf) {
+		for (i = 0; i < rx->size; i++) {
+			rb = &rx->buf[i];
+			if (!rb->page)
+				continue;
+			dma_unmap_page(dev, rb->dma, PAGE_SIZE,
+					DMA_FROM_DEVICE);
+			put_page(rb->page);
+		}
+		kfree(rx->buf);
+	}
+	rx->buf = NULL;
+}
+
+static void pcnet_dummy_free_tx_ring(struct pcnet_private *pp,
+		struct pcnet_tx_ring *tx)
+{
+	struct device *dev = &pp->pci_dev->dev;
+	struct pcnet_buffer *buf;
+	unsigned int i;
+
+	if (tx->buf) {
+		for (i = 0; i < tx->size; i++) {
+			buf = &tx->buf[i];
+			if (buf->len)
+				pcnet_dummy_unmap_tx(pp, buf);
+			if (buf->skb)
+				dev_kfree_skb(buf->skb);
+		}
+		kfree(tx->buf);
+	}
+	if (tx->bounce)
+		dma_free_coherent(dev, PCNET_TX_BOUNCE_LEN * tx->size,
+				tx->bounce, tx->bounce_dma);
+	tx->buf = NULL;
+	tx->bounce = NULL;
+}
+
+/* Every RX descriptor gets a page and is handed to the controller. */
+static int pcnet_dummy_alloc_rx_ring(struct pcnet_private *pp,
+		struct pcnet_rx_ring *rx, unsigned int size,
+		struct xmit_descr *desc, dma_addr_t dma)
+{
+	struct pcnet_rx_buffer *rb;
+	unsigned int i;
+
+	BUILD_BUG_ON(PCNET_RX_HEADROOM + PCNET_RX_BUF_LEN +
+			SKB_DATA_ALIGN(sizeof(struct skb_shared_info)) >
+			PCNET_RX_TRUESIZE);
+
+	rx->desc = desc;
+	rx->dma = dma;
+	rx->size = size;
+	rx->cur = 0;
+	rx->buf = kcalloc(size, sizeof(*rx->buf), GFP_KERNEL);
+	if (!rx->buf)
+		return -ENOMEM;
+
+	for (i = 0; i < size; i++) {
+		rb = &rx->buf[i];
+		if (pcnet_dummy_alloc_rx_page(pp, rb, GFP_KERNEL))
+			goto err;
+		pcnet_dummy_give_descr(&rx->desc[i],
+				rb->dma + rb->offset + PCNET_RX_HEADROOM,
+				PCNET_RX_BUF_LEN, 0);
+	}
+
+	return 0;
+
+err:
+	pcnet_dummy_free_rx_ring(pp, rx);
+	return -ENOMEM;
+}
+
+static int pcnet_dummy_alloc_tx_ring(struct pcnet_private *pp,
+		struct pcnet_tx_ring *tx, unsigned int size,
+		struct xmit_descr *desc, dma_addr_t dma)
+{
+	struct device *dev = &pp->pci_dev->dev;
+
+	tx->desc = desc;
+	tx->dma = dma;
+	tx->size = size;
+	tx->cur = 0;
+	tx->dirty = 0;
+	tx->bounce = dma_alloc_coherent(dev, PCNET_TX_BOUNCE_LEN * size,
+			&tx->bounce_dma, GFP_KERNEL);
+	tx->buf = kcalloc(size, sizeof(*tx->buf), GFP_KERNEL);
+	if (!tx->bounce || !tx->buf)
+		goto err;
+
+	return 0;
+
+err:
+	pcnet_dummy_free_tx_ring(pp, tx);
+	return -ENOMEM;
+}
+
+static void pcnet_dummy_setup_filter(struct pcnet_private *pp)
+{
+	struct pcnet_dummy_init_block *ib = pp->init_block;
+
+	ib->mode = cpu_to_le16(pp->ndev->flags & IFF_PROMISC ? CSR15_PROM : 0);
+	ib->laddr_filter_low = cpu_to_le32(pp->mc_filter[0] |
+			pp->mc_filter[1] << 16);
+	ib->laddr_filter_hi = cpu_to_le32(pp->mc_filter[2] |
+			pp->mc_filter[3] << 16);
+}
+
+/* Fills the init block from the current rings, read by the next INIT. */
+static void pcnet_dummy_setup_init_block(struct pcnet_private *pp)
+{
+	struct pcnet_dummy_init_block *ib = pp->init_block;
+
+	ib->txlen_rxlen = cpu_to_le16(ilog2(pp->tx.size) << 12 |
+			ilog2(pp->rx.size) << 4);
+	memcpy(ib->mac_addr, pp->ndev->dev_addr, sizeof(ib->mac_addr));
+	ib->reserved = 0;
+	pcnet_dummy_setup_filter(pp);
+	ib->rx_ring = cpu_to_le32(pp->rx.dma);
+	ib->tx_ring = cpu_to_le32(pp->tx.dma);
+	wmb();
+}
+
+/* The init block and both descriptor rings share one coherent
+ * allocation. Each ring starts on a cache line of its own, so the
+ * descriptors the controller writes back don't share a line with the
+ * other ring or the init block. It also gives the 16 byte alignment
+ * the controller requires.
+ */
+static inline size_t pcnet_dummy_rx_ring_offset(void)
+{
+	return ALIGN(sizeof(struct pcnet_dummy_init_block), L1_CACHE_BYTES);
+}
+
+static inline size_t pcnet_dummy_tx_ring_offset(unsigned int rx_size)
+{
+	return ALIGN(pcnet_dummy_rx_ring_offset() +
+			sizeof(struct xmit_descr) * rx_size, L1_CACHE_BYTES);
+}
+
+static inline size_t pcnet_dummy_block_len(unsigned int rx_size,
+		unsigned int tx_size)
+{
+	return pcnet_dummy_tx_ring_offset(rx_size) +
+		sizeof(struct xmit_descr) * tx_size;
+}
+
+static void pcnet_dummy_free_rings(struct pcnet_private *pp,
+		struct pcnet_dummy_init_block *ib, dma_addr_t ib_dma,
+		struct pcnet_rx_ring *rx, struct pcnet_tx_ring *tx)
+{
+	pcnet_dummy_free_tx_ring(pp, tx);
+	pcnet_dummy_free_rx_ring(pp, rx);
+	dma_free_coherent(&pp->pci_dev->dev,
+			pcnet_dummy_block_len(rx->size, tx->size), ib, ib_dma);
+}
+
+/* Returns the init block, which is also the start of the block, or
+ * NULL if out of memory.
+ */
+static struct pcnet_dummy_init_block *pcnet_dummy_alloc_rings(
+		struct pcnet_private *pp, dma_addr_t *ib_dma,
+		struct pcnet_rx_ring *rx, unsigned int rx_size,
+		struct pcnet_tx_ring *tx, unsigned int tx_size)
+{
+	size_t rx_off = pcnet_dummy_rx_ring_offset();
+	size_t tx_off = pcnet_dummy_tx_ring_offset(rx_size);
+	size_t len = pcnet_dummy_block_len(rx_size, tx_size);
+	void *block;
+	dma_addr_t dma;
+
+	block = dma_alloc_coherent(&pp->pci_dev->dev, len, &dma, GFP_KERNEL);
+	if (!block)
+		return NULL;
+	memset(block, 0, len);
+
+	if (pcnet_dummy_alloc_rx_ring(pp, rx, rx_size, block + rx_off,
+				dma + rx_off))
+		goto err_block;
+	if (pcnet_dummy_alloc_tx_ring(pp, tx, tx_size, block + tx_off,
+				dma + tx_off))
+		goto err_rx;
+	*ib_dma = dma;
+
+	return block;
+
+err_rx:
+	pcnet_dummy_free_rx_ring(pp, rx);
+err_block:
+	dma_free_coherent(&pp->pci_dev->dev, len, block, dma);
+	return NULL;
+}
+
+/* Loads the init block and starts the controller, which must be
+ * stopped before.
+ */
+static int pcnet_dummy_init_chip(struct pcnet_private *pp)
+{
+	unsigned int i;
+
+	write_bcr(BCR20, BCR20_SWSTYLE_PCNET_PCI);
+	write_csr(CSR1, pp->init_block_dma & 0xffff);
+	write_csr(CSR2, pp->init_block_dma >> 16);
+	write_csr(CSR4, read_csr(CSR4) | CSR4_APAD_XMT);
+
+	pp->iena = 0;
+	write_csr(CSR0, CSR0_INIT);
+	for (i = 0; i < PCNET_INIT_TIMEOUT; i++) {
+		if (read_csr(CSR0) & CSR0_IDON)
+			break;
+		udelay(1);
+	}
+	if (i == PCNET_INIT_TIMEOUT)
+		return -ETIMEDOUT;
+	/* INIT reloads CSR15 from the init block */
+	pp->regs.shadow_valid = 0;
+	pp->tx_tint = false;
+	pp->itr_holdoff = false;
+	write_csr(CSR3, CSR3_TINTM);
+	pp->iena = CSR0_IENA;
+	write_csr(CSR0, CSR0_IDON | CSR0_IENA | CSR0_STRT);
+
+	return 0;
+}
+
+/* Small frames are copied into a new skb and the buffer stays in the
+ * ring. Of larger ones only the headers are copied, the rest is attached
+ * to the skb as a page fragment. The page is flipped to its other half
+ * if the stack has already released that one, otherwise the slot gets a
+ * fresh page. NULL means the frame is dropped and the buffer is reused.
+ */
+static struct sk_buff *pcnet_dummy_rx_skb(struct pcnet_private *pp,
+		unsigned int i, unsigned int len)
+{
+	struct device *dev = &pp->pci_dev->dev;
+	struct pcnet_rx_buffer *rb = &pp->rx.buf[i];
+	struct pcnet_rx_buffer old = *rb;
+	struct sk_buff *skb;
+	void *data;
+
+	data = page_address(rb->page) + rb->offset;
+	dma_sync_single_range_for_cpu(dev, rb->dma,
+			rb->offset + PCNET_RX_HEADROOM, len, DMA_FROM_DEVICE);
+	if (len < rx_copybreak) {
+		skb = netdev_alloc_skb_ip_align(pp->ndev, len);
+		if (skb) {
+			skb_copy_to_linear_data(skb, data + PCNET_RX_HEADROOM,
+					len);
+			skb_put(skb, len);
+		}
+		goto recycle;
+	}
+
+	/* the skb is built around the received frame and takes over one
+	 * page reference, the data is not copied
+	 */
+	skb = build_skb(data, PCNET_RX_TRUESIZE);
+	if (!skb)
+		goto recycle;
+	if (page_count(rb->page) == 1 &&
+			page_to_nid(rb->page) == numa_node_id()) {
+		/* one reference for the skb, ours is kept */
+		get_page(rb->page);
+		rb->offset ^= PAGE_SIZE / 2;
+		dma_sync_single_range_for_device(dev, rb->dma,
+				rb->offset + PCNET_RX_HEADROOM,
+				PCNET_RX_BUF_LEN, DMA_FROM_DEVICE);
+		pp->rx_pages_recycled++;
+	} else if (pcnet_dummy_alloc_rx_page(pp, rb, GFP_ATOMIC)) {
+		/* freeing the skb must not drop our reference */
+		get_page(old.page);
+		dev_kfree_skb(skb);
+		skb = NULL;
+		goto recycle;
+	} else {
+		/* our reference goes to the skb */
+		dma_unmap_page(dev, old.dma, PAGE_SIZE, DMA_FROM_DEVICE);
+		pp->rx_pages_alloc++;
+	}
+	skb_reserve(skb, PCNET_RX_HEADROOM);
+	skb_put(skb, len);
+
+	return skb;
+
+recycle:
+	dma_sync_single_range_for_device(dev, old.dma,
+			old.offset + PCNET_RX_HEADROOM, len, DMA_FROM_DEVICE);
+	return skb;
+}
+
+static int pcnet_dummy_rx(struct net_device *ndev, int budget)
+{
+	struct pcnet_private *pp = netdev_priv(ndev);
+	struct pcnet_rx_buffer *rb;
+	struct pcnet_stats *ps;
+	struct xmit_descr *d;
+	struct sk_buff *skb;
+	unsigned int i, len;
+	unsigned int packets = 0, bytes = 0;
+	int work = 0;
+	u16 status;
+
+	while (work < budget) {
+		i = pp->rx.cur & (pp->rx.size - 1);
+		d = &pp->rx.desc[i];
+		status = le16_to_cpu(d->status);
+		if (status & DESC_OWN)
+			break;
+		rmb();
+		rb = &pp->rx.buf[i];
+
+		/* buffers are large enough to hold a whole frame, so
+		 * anything else than STP|ENP is an error
+		 */
+		if ((status & (DESC_ERR | DESC_STP | DESC_ENP)) !=
+				(DESC_STP | DESC_ENP)) {
+			ndev->stats.rx_errors++;
+			if (status & DESC_RX_CRC)
+				ndev->stats.rx_crc_errors++;
+			if (status & DESC_RX_FRAM)
+				ndev->stats.rx_frame_errors++;
+			if (status & (DESC_RX_OFLO | DESC_RX_BUFF))
+				ndev->stats.rx_fifo_errors++;
+			goto next;
+		}
+
+		/* strip FCS */
+		len = (le32_to_cpu(d->flags) & RMD2_MCNT_MASK) - ETH_FCS_LEN;
+		if (len < ETH_ZLEN || len > PCNET_RX_BUF_LEN) {
+			ndev->stats.rx_errors++;
+			ndev->stats.rx_length_errors++;
+			goto next;
+		}
+		skb = pcnet_dummy_rx_skb(pp, i, len);
+		if (!skb) {
+			ndev->stats.rx_dropped++;
+			goto next;
+		}
+		skb->protocol = eth_type_trans(skb, ndev);
+		trace_pcnet_dummy_rx(ndev, i, len);
+		if (pcnet_dummy_hist_on(pp) && ktime_to_ns(pp->rx_stamp))
+			pcnet_dummy_hist_add(&pp->rx_hist, pp->rx_stamp,
+					ktime_get());
+		/* merged per flow, flushed by napi_complete() */
+		napi_gro_receive(&pp->napi, skb);
+		packets++;
+		bytes += len;
+next:
+		pcnet_dummy_give_descr(d,
+				rb->dma + rb->offset + PCNET_RX_HEADROOM,
+				PCNET_RX_BUF_LEN, 0);
+		pp->rx.cur++;
+		work++;
+	}
+
+	ps = this_cpu_ptr(pp->stats);
+	u64_stats_update_begin(&ps->syncp);
+	ps->rx_packets += packets;
+	ps->rx_bytes += bytes;
+	u64_stats_update_end(&ps->syncp);
+
+	return work;
+}
+
+/* returns the number of frames reclaimed */
+static int pcnet_dummy_tx_reclaim(struct net_device *ndev)
+{
+	struct pcnet_private *pp = netdev_priv(ndev);
+	struct pcnet_buffer *buf;
+	struct xmit_descr *d;
+	struct pcnet_stats *ps;
+	unsigned int bytes = 0;
+	unsigned int tx_packets = 0, tx_bytes = 0;
+	unsigned int dirty = pp->tx.dirty;
+	unsigned int i;
+	int done = 0;
+	u32 flags;
+	ktime_t now;
+
+	if (pcnet_dummy_hist_on(pp))
+		now = ktime_get();
+	else
+		now = ktime_set(0, 0);
+
+	while (dirty != pp->tx.cur) {
+		i = dirty & (pp->tx.size - 1);
+		d = &pp->tx.desc[i];
+		if (le16_to_cpu(d->status) & DESC_OWN)
+			break;
+		rmb();
+		buf = &pp->tx.buf[i];
+
+		if (le16_to_cpu(d->status) & DESC_ERR) {
+			flags = le32_to_cpu(d->flags);
+			ndev->stats.tx_errors++;
+			if (flags & TMD2_LCAR)
+				ndev->stats.tx_carrier_errors++;
+			if (flags & TMD2_LCOL)
+				ndev->stats.tx_window_errors++;
+			if (flags & TMD2_RTRY)
+				ndev->stats.tx_aborted_errors++;
+			if (flags & (TMD2_UFLO | TMD2_BUFF))
+				ndev->stats.tx_fifo_errors++;
+		} else if (buf->bytes) {
+			tx_packets++;
+			tx_bytes += buf->bytes;
+		}
+		pcnet_dummy_unmap_tx(pp, buf);
+		if (buf->skb) {
+			dev_kfree_skb_any(buf->skb);
+			buf->skb = NULL;
+		}
+		if (buf->bytes) {
+			if (ktime_to_ns(now) && ktime_to_ns(buf->stamp))
+				pcnet_dummy_hist_add(&pp->tx_hist, buf->stamp,
+						now);
+			buf->stamp = ktime_set(0, 0);
+			bytes += buf->bytes;
+			buf->bytes = 0;
+			done++;
+		}
+		dirty++;
+	}
+	/* start_xmit fills the slots without the lock, they must be seen
+	 * cleared before they are seen free
+	 */
+	smp_wmb();
+	pp->tx.dirty = dirty;
+	netdev_completed_queue(ndev, done, bytes);
+	if (tx_packets) {
+		ps = this_cpu_ptr(pp->stats);
+		u64_stats_update_begin(&ps->syncp);
+		ps->tx_packets += tx_packets;
+		ps->tx_bytes += tx_bytes;
+		u64_stats_update_end(&ps->syncp);
+	}
+	if (done)
+		trace_pcnet_dummy_tx_reclaim(ndev, done, bytes,
+				pp->tx.cur - pp->tx.dirty);
+
+	if (netif_queue_stopped(ndev) &&
+			pcnet_dummy_tx_avail(pp) >= PCNET_TX_DESC_MAX)
+		netif_wake_queue(ndev);
+
+	return done;
+}
+
+static irqreturn_t pcnet_dummy_interrupt(int irq, void *dev_id)
+{
+	struct net_device *ndev = dev_id;
+	struct pcnet_private *pp = netdev_priv(ndev);
+	u32 csr0;
+
+	spin_lock(&pp->lock);
+	csr0 = read_csr(CSR0);
+	trace_pcnet_dummy_irq(ndev, csr0);
+	/* with IENA cleared the line is not ours, NAPI is polling */
+	if ((csr0 & (CSR0_INTR | CSR0_IENA)) != (CSR0_INTR | CSR0_IENA)) {
+		spin_unlock(&pp->lock);
+		return IRQ_NONE;
+	}
+	/* Acknowledge all pending events and clear IENA in one write. Events
+	 * arriving while polling stay latched in CSR0 and raise a new
+	 * interrupt as soon as the poll routine sets IENA again.
+	 */
+	pp->iena = 0;
+	write_csr(CSR0, csr0 & CSR0_INT_ACK);
+
+	if (csr0 & (CSR0_RINT | CSR0_TINT)) {
+		if ((csr0 & CSR0_RINT) && pcnet_dummy_hist_on(pp) &&
+				!ktime_to_ns(pp->rx_stamp))
+			pp->rx_stamp = ktime_get();
+		if (napi_schedule_prep(&pp->napi))
+			__napi_schedule(&pp->napi);
+	} else {
+		pp->iena = CSR0_IENA;
+		write_csr(CSR0, CSR0_IENA);
+	}
+	if (csr0 & CSR0_MISS)
+		ndev->stats.rx_missed_errors++;
+	if (csr0 & CSR0_BABL)
+		ndev->stats.tx_errors++;
+	if (csr0 & CSR0_MERR)
+		netdev_err(ndev, "memory error, csr0 = %#06x\n", csr0);
+	spin_unlock(&pp->lock);
+
+	return IRQ_HANDLED;
+}
+
+/* PCnet has no interrupt coalescing timer, the hold-off is done in
+ * software. Returns the time RINT/TINT stay masked after a poll that
+ * handled 'frames' frames. The adaptive mode follows e1000's ITR: few
+ * frames per poll mean latency sensitive traffic and no hold-off, many
+ * mean bulk traffic and a long one. The hold-off grows slowly and
+ * drops at once.
+ */
+static unsigned int pcnet_dummy_itr_update(struct pcnet_private *pp,
+		int frames)
+{
+	unsigned int target;
+
+	if (!pp->adaptive_rx) {
+		pp->itr_usecs = frames ? pp->rx_usecs : 0;
+		return pp->itr_usecs;
+	}
+
+	if (frames < PCNET_ITR_LOWEST_FRAMES)
+		target = 0;
+	else if (frames < PCNET_ITR_BULK_FRAMES)
+		target = PCNET_ITR_LOW_USECS;
+	else
+		target = PCNET_ITR_BULK_USECS;
+	if (target > pp->itr_usecs)
+		pp->itr_usecs = (pp->itr_usecs * 3 + target + 3) / 4;
+	else
+		pp->itr_usecs = target;
+
+	return pp->itr_usecs;
+}
+
+/* RINT and TINT are masked during an interrupt hold-off, TINT also
+ * while TX completions are reclaimed lazily. CSR3 is written only if
+ * that changes anything, its value comes from the shadow copy.
+ */
+static void pcnet_dummy_update_intr_mask(struct pcnet_private *pp)
+{
+	u32 csr3 = read_csr(CSR3) & ~(CSR3_RINTM | CSR3_TINTM);
+
+	if (pp->itr_holdoff)
+		csr3 |= CSR3_RINTM | CSR3_TINTM;
+	else if (!pp->tx_tint)
+		csr3 |= CSR3_TINTM;
+	if (csr3 != read_csr(CSR3))
+		write_csr(CSR3, csr3);
+}
+
+static enum hrtimer_restart pcnet_dummy_itr_timer(struct hrtimer *timer)
+{
+	struct pcnet_private *pp = container_of(timer, struct pcnet_private,
+			itr_timer);
+	unsigned long flags;
+
+	/* events latched meanwhile raise the interrupt right away */
+	spin_lock_irqsave(&pp->lock, flags);
+	pp->itr_holdoff = false;
+	pcnet_dummy_update_intr_mask(pp);
+	spin_unlock_irqrestore(&pp->lock, flags);
+
+	return HRTIMER_NORESTART;
+}
+
+/* The poll runs with IENA cleared, as when scheduled by the ISR. An
+ * interrupt taken meanwhile would acknowledge events the poll has
+ * already passed and could not schedule it again.
+ */
+static void pcnet_dummy_tx_timer(unsigned long data)
+{
+	struct pcnet_private *pp = (struct pcnet_private *)data;
+	unsigned long flags;
+
+	spin_lock_irqsave(&pp->lock, flags);
+	if (napi_schedule_prep(&pp->napi)) {
+		pp->iena = 0;
+		write_csr(CSR0, 0);
+		__napi_schedule(&pp->napi);
+	}
+	spin_unlock_irqrestore(&pp->lock, flags);
+}
+
+/* TX reclaim and RX in one pass, interrupts are re-armed only when the
+ * RX ring has been drained within the budget.
+ */
+static int pcnet_dummy_poll(struct napi_struct *napi, int budget)
+{
+	struct pcnet_private *pp = container_of(napi, struct pcnet_private,
+			napi);
+	struct net_device *ndev = pp->ndev;
+	unsigned long flags;
+	unsigned int usecs;
+	int work, tx_done;
+
+	spin_lock_irqsave(&pp->lock, flags);
+	tx_done = pcnet_dummy_tx_reclaim(ndev);
+	if (pp->tx_tint &&
+			pp->tx.cur - pp->tx.dirty < PCNET_TX_LOWAT(pp) &&
+			!netif_xmit_stopped(netdev_get_tx_queue(ndev, 0))) {
+		pp->tx_tint = false;
+		pcnet_dummy_update_intr_mask(pp);
+	}
+	if (!pp->tx_tint && pp->tx.cur != pp->tx.dirty)
+		mod_timer(&pp->tx_timer,
+				jiffies + msecs_to_jiffies(PCNET_TX_RECLAIM_MSECS));
+	spin_unlock_irqrestore(&pp->lock, flags);
+
+	work = pcnet_dummy_rx(ndev, budget);
+	if (work < budget) {
+		napi_complete(napi);
+		spin_lock_irqsave(&pp->lock, flags);
+		/* CSR3 reads come from the shadow copy */
+		usecs = pcnet_dummy_itr_update(pp, work + tx_done);
+		pp->itr_holdoff = usecs != 0;
+		pcnet_dummy_update_intr_mask(pp);
+		if (usecs)
+			hrtimer_start(&pp->itr_timer,
+					ns_to_ktime(usecs * NSEC_PER_USEC),
+					HRTIMER_MODE_REL);
+		pp->rx_stamp = ktime_set(0, 0);
+		pp->iena = CSR0_IENA;
+		write_csr(CSR0, CSR0_IENA);
+		spin_unlock_irqrestore(&pp->lock, flags);
+	}
+
+	return work;
 }
 
 static int pcnet_dummy_open(struct net_device *ndev)
 {
 	struct pcnet_private *pp;
+	int rc;
 
 	pp = netdev_priv(ndev);
-	if (pcnet_dummy_reset(pp->base)) {
+	if (pcnet_dummy_reset(pp)) {
 		netdev_err(ndev, "reset network controller failed\n");
 		return -EBUSY;
 	}
-	if (pcnet_dummy_switch_dword_mode(pp->base)) {
-		netdev_err(ndev, "switch to dword mode failed\n");
-		netdev_err(ndev, "driver operates only in dword mode\n");
-		return -EBUSY;
-	}
 
 	/* init DMA rings */
+	pp->init_block = pcnet_dummy_alloc_rings(pp, &pp->init_block_dma,
+			&pp->rx, pp->rx_pending, &pp->tx, pp->tx_pending);
+	if (!pp->init_block)
+		return -ENOMEM;
+	pcnet_dummy_setup_init_block(pp);
+
+	rc = request_irq(ndev->irq, pcnet_dummy_interrupt, IRQF_SHARED,
+			ndev->name, ndev);
+	if (rc)
+		goto out_rings;
+
+	napi_enable(&pp->napi);
+	spin_lock_irq(&pp->lock);
+	rc = pcnet_dummy_init_chip(pp);
+	spin_unlock_irq(&pp->lock);
+	if (rc) {
+		netdev_err(ndev, "controller initialization timed out\n");
+		goto out_irq;
+	}
+	netdev_reset_queue(ndev);
+	netif_start_queue(ndev);
 
 	return 0;
+
+out_irq:
+	napi_disable(&pp->napi);
+	free_irq(ndev->irq, ndev);
+out_rings:
+	pcnet_dummy_reset(pp);
+	pcnet_dummy_free_rings(pp, pp->init_block, pp->init_block_dma,
+			&pp->rx, &pp->tx);
+	pp->init_block = NULL;
+	return rc;
 }
 
 static int pcnet_dummy_stop(struct net_device *ndev)
 {
+	struct pcnet_private *pp = netdev_priv(ndev);
+	struct pcnet_dummy_init_block *ib;
+
+	netif_stop_queue(ndev);
+	napi_disable(&pp->napi);
+	hrtimer_cancel(&pp->itr_timer);
+	del_timer_sync(&pp->tx_timer);
+	spin_lock_irq(&pp->lock);
+	pp->iena = 0;
+	write_csr(CSR0, CSR0_STOP);
+	/* hidden from set_rx_mode before it goes away */
+	ib = pp->init_block;
+	pp->init_block = NULL;
+	spin_unlock_irq(&pp->lock);
+	free_irq(ndev->irq, ndev);
+	pcnet_dummy_free_rings(pp, ib, pp->init_block_dma, &pp->rx, &pp->tx);
+
+	return 0;
+}
+
+static struct rtnl_link_stats64 *pcnet_dummy_get_stats64(
+		struct net_device *ndev, struct rtnl_link_stats64 *stats)
+{
+	struct pcnet_private *pp = netdev_priv(ndev);
+	const struct pcnet_stats *ps;
+	u64 rx_packets, rx_bytes, tx_packets, tx_bytes;
+	unsigned int start;
+	int cpu;
+
+	netdev_stats_to_stats64(stats, &ndev->stats);
+	for_each_possible_cpu(cpu) {
+		ps = per_cpu_ptr(pp->stats, cpu);
+		do {
+			start = u64_stats_fetch_begin_bh(&ps->syncp);
+			rx_packets = ps->rx_packets;
+			rx_bytes = ps->rx_bytes;
+			tx_packets = ps->tx_packets;
+			tx_bytes = ps->tx_bytes;
+		} while (u64_stats_fetch_retry_bh(&ps->syncp, start));
+		stats->rx_packets += rx_packets;
+		stats->rx_bytes += rx_bytes;
+		stats->tx_packets += tx_packets;
+		stats->tx_bytes += tx_bytes;
+	}
+
+	return stats;
+}
+
+/* Status bits of CSR0 are write-one-to-clear, so TDMD is written
+ * together with the current IENA and nothing else. No read of CSR0 is
+ * needed for that.
+ */
+static inline void pcnet_dummy_kick_tx(struct pcnet_private *pp)
+{
+	write_csr(CSR0, pp->iena | CSR0_TDMD);
+}
+
+/* Copies a small frame to the bounce slot of its descriptor, which is
+ * cheaper than a streaming mapping with an IOMMU. The slot is coherent,
+ * the barrier before OWN is enough to make the copy visible.
+ */
+static int pcnet_dummy_bounce_tx(struct pcnet_private *pp,
+		struct sk_buff *skb, unsigned int first)
+{
+	unsigned int i = first & (pp->tx.size - 1);
+	struct pcnet_buffer *buf = &pp->tx.buf[i];
+
+	skb_copy_bits(skb, 0, pp->tx.bounce + i * PCNET_TX_BOUNCE_LEN,
+			skb->len);
+	buf->dma = pp->tx.bounce_dma + i * PCNET_TX_BOUNCE_LEN;
+	buf->len = skb->len;
+	buf->frag = false;
+	buf->bounce = true;
+
+	return 1;
+}
+
+/* Maps the linear part and every fragment of the skb to consecutive
+ * descriptors starting at 'first'. Returns the number of descriptors
+ * used or a negative value if a mapping failed.
+ */
+static int pcnet_dummy_map_tx(struct pcnet_private *pp, struct sk_buff *skb,
+		unsigned int first)
+{
+	struct device *dev = &pp->pci_dev->dev;
+	struct skb_shared_info *si = skb_shinfo(skb);
+	struct pcnet_buffer *buf;
+	const skb_frag_t *frag;
+	unsigned int f;
+	int n = 0;
+
+	if (skb_headlen(skb)) {
+		buf = &pp->tx.buf[first & (pp->tx.size - 1)];
+		buf->dma = dma_map_single(dev, skb->data, skb_headlen(skb),
+				DMA_TO_DEVICE);
+		if (dma_mapping_error(dev, buf->dma))
+			return -ENOMEM;
+		buf->len = skb_headlen(skb);
+		buf->frag = false;
+		buf->bounce = false;
+		n++;
+	}
+	for (f = 0; f < si->nr_frags; f++) {
+		frag = &si->frags[f];
+		buf = &pp->tx.buf[(first + n) & (pp->tx.size - 1)];
+		buf->dma = skb_frag_dma_map(dev, frag, 0, skb_frag_size(frag),
+				DMA_TO_DEVICE);
+		if (dma_mapping_error(dev, buf->dma))
+			goto err;
+		buf->len = skb_frag_size(frag);
+		buf->frag = true;
+		buf->bounce = false;
+		n++;
+	}
+
+	return n;
+
+err:
+	while (n--)
+		pcnet_dummy_unmap_tx(pp,
+				&pp->tx.buf[(first + n) & (pp->tx.size - 1)]);
+	return -ENOMEM;
+}
+
+static netdev_tx_t pcnet_dummy_start_xmit(struct sk_buff *skb,
+		struct net_device *ndev)
+{
+	struct pcnet_private *pp = netdev_priv(ndev);
+	struct pcnet_buffer *buf;
+	unsigned long flags;
+	unsigned int first, i;
+	bool bounce;
+	int n, j;
+	u16 status;
+
+	if (pcnet_dummy_tx_avail(pp) < skb_shinfo(skb)->nr_frags + 1) {
+		/* never happens, the queue is stopped in advance */
+		netif_stop_queue(ndev);
+		return NETDEV_TX_BUSY;
+	}
+	/* pairs with smp_wmb() in tx_reclaim, the free slots are cleared */
+	smp_rmb();
+	/* the controller can't checksum, NETIF_F_HW_CSUM is advertised
+	 * only because the core refuses NETIF_F_SG without it
+	 */
+	if (skb->ip_summed == CHECKSUM_PARTIAL && skb_checksum_help(skb))
+		goto drop;
+
+	first = pp->tx.cur;
+	bounce = skb->len < tx_copybreak && skb->len <= PCNET_TX_BOUNCE_LEN;
+	if (bounce)
+		n = pcnet_dummy_bounce_tx(pp, skb, first);
+	else
+		n = pcnet_dummy_map_tx(pp, skb, first);
+	if (n < 0)
+		goto drop;
+	buf = &pp->tx.buf[(first + n - 1) & (pp->tx.size - 1)];
+	buf->bytes = skb->len;
+	if (pcnet_dummy_hist_on(pp))
+		buf->stamp = ktime_get();
+	if (!bounce)
+		buf->skb = skb;
+
+	spin_lock_irqsave(&pp->lock, flags);
+	/* OWN of the STP descriptor goes last, so the controller never
+	 * sees a partially built chain
+	 */
+	for (j = n - 1; j >= 0; j--) {
+		i = (first + j) & (pp->tx.size - 1);
+		buf = &pp->tx.buf[i];
+		status = 0;
+		if (j == 0)
+			status |= DESC_STP;
+		if (j == n - 1)
+			status |= DESC_ENP;
+		pcnet_dummy_give_descr(&pp->tx.desc[i], buf->dma, buf->len,
+				status);
+	}
+	pp->tx.cur += n;
+	netdev_sent_queue(ndev, skb->len);
+	trace_pcnet_dummy_xmit(ndev, first & (pp->tx.size - 1), skb->len,
+			pp->tx.cur - pp->tx.dirty);
+	pcnet_dummy_kick_tx(pp);
+
+	if (!pp->tx_tint) {
+		pcnet_dummy_tx_reclaim(ndev);
+		/* the queue can only be woken up by TINT, BQL may have
+		 * stopped it below the high watermark
+		 */
+		if (pp->tx.cur - pp->tx.dirty >= PCNET_TX_HIWAT(pp) ||
+				pcnet_dummy_tx_avail(pp) < PCNET_TX_DESC_MAX ||
+				netif_xmit_stopped(netdev_get_tx_queue(ndev, 0))) {
+			pp->tx_tint = true;
+			pcnet_dummy_update_intr_mask(pp);
+		} else if (!timer_pending(&pp->tx_timer)) {
+			mod_timer(&pp->tx_timer, jiffies +
+					msecs_to_jiffies(PCNET_TX_RECLAIM_MSECS));
+		}
+	}
+	if (pcnet_dummy_tx_avail(pp) < PCNET_TX_DESC_MAX)
+		netif_stop_queue(ndev);
+	spin_unlock_irqrestore(&pp->lock, flags);
+	/* the frame is in the bounce slot, the skb is not needed anymore */
+	if (bounce)
+		consume_skb(skb);
+
+	return NETDEV_TX_OK;
+
+drop:
+	dev_kfree_skb(skb);
+	ndev->stats.tx_dropped++;
+	return NETDEV_TX_OK;
+}
+
+/* LADRF and CSR15 may only be written while the controller is stopped
+ * or suspended. Suspend lets the frames in progress complete and keeps
+ * the rings as they are, so no INIT is needed. The lock is dropped while
+ * waiting for the suspend, as in pcnet32_suspend(). If the controller
+ * was stopped or reinitialized meanwhile, the next INIT loads the filter.
+ */
+static void pcnet_dummy_load_filter(struct pcnet_private *pp,
+		unsigned long *flags)
+{
+	struct pcnet_dummy_init_block *ib = pp->init_block;
+	unsigned int i;
+	u16 csr5;
+	u16 csr15;
+
+	csr5 = read_csr(CSR5);
+	write_csr(CSR5, csr5 | CSR5_SPND);
+	for (i = 0; i < PCNET_SPND_TIMEOUT; i++) {
+		if (read_csr(CSR5) & CSR5_SPND)
+			break;
+		spin_unlock_irqrestore(&pp->lock, *flags);
+		udelay(10);
+		spin_lock_irqsave(&pp->lock, *flags);
+		if (pp->init_block != ib || (read_csr(CSR0) & CSR0_STOP))
+			return;
+	}
+	if (i == PCNET_SPND_TIMEOUT) {
+		netdev_warn(pp->ndev, "suspend timed out, filter not loaded\n");
+	} else {
+		write_csr(CSR8, pp->mc_filter[0]);
+		write_csr(CSR9, pp->mc_filter[1]);
+		write_csr(CSR10, pp->mc_filter[2]);
+		write_csr(CSR11, pp->mc_filter[3]);
+		csr15 = read_csr(CSR15) & ~CSR15_PROM;
+		if (pp->ndev->flags & IFF_PROMISC)
+			csr15 |= CSR15_PROM;
+		write_csr(CSR15, csr15);
+	}
+	write_csr(CSR5, csr5 & ~CSR5_SPND);
+}
+
+/* The filter bit of a multicast address is selected by the 6 most
+ * significant bits of its little endian CRC.
+ */
+static void pcnet_dummy_set_rx_mode(struct net_device *ndev)
+{
+	struct pcnet_private *pp = netdev_priv(ndev);
+	struct netdev_hw_addr *ha;
+	unsigned long flags;
+	u16 filter[4];
+	u32 crc;
+
+	if (ndev->flags & (IFF_PROMISC | IFF_ALLMULTI)) {
+		memset(filter, 0xff, sizeof(filter));
+	} else {
+		memset(filter, 0, sizeof(filter));
+		netdev_for_each_mc_addr(ha, ndev) {
+			crc = ether_crc_le(ETH_ALEN, ha->addr) >> 26;
+			filter[crc >> 4] |= 1 << (crc & 0xf);
+		}
+	}
+
+	spin_lock_irqsave(&pp->lock, flags);
+	memcpy(pp->mc_filter, filter, sizeof(filter));
+	if (netif_running(ndev) && pp->init_block) {
+		/* a stopped controller picks it up with the next INIT */
+		pcnet_dummy_setup_filter(pp);
+		if (!(read_csr(CSR0) & CSR0_STOP))
+			pcnet_dummy_load_filter(pp, &flags);
+	}
+	spin_unlock_irqrestore(&pp->lock, flags);
+}
+
+static const char pcnet_dummy_gstrings[][ETH_GSTRING_LEN] = {
+	"rx_pages_recycled",
+	"rx_pages_alloc",
+};
+
+static int pcnet_dummy_get_sset_count(struct net_device *ndev, int sset)
+{
+	if (sset != ETH_SS_STATS)
+		return -EOPNOTSUPP;
+	return ARRAY_SIZE(pcnet_dummy_gstrings);
+}
+
+static void pcnet_dummy_get_strings(struct net_device *ndev, u32 sset,
+		u8 *data)
+{
+	if (sset == ETH_SS_STATS)
+		memcpy(data, pcnet_dummy_gstrings,
+				sizeof(pcnet_dummy_gstrings));
+}
+
+static void pcnet_dummy_get_ethtool_stats(struct net_device *ndev,
+		struct ethtool_stats *stats, u64 *data)
+{
+	struct pcnet_private *pp = netdev_priv(ndev);
+
+	data[0] = pp->rx_pages_recycled;
+	data[1] = pp->rx_pages_alloc;
+}
+
+static int pcnet_dummy_get_coalesce(struct net_device *ndev,
+		struct ethtool_coalesce *ec)
+{
+	struct pcnet_private *pp = netdev_priv(ndev);
+
+	ec->rx_coalesce_usecs = pp->rx_usecs;
+	ec->use_adaptive_rx_coalesce = pp->adaptive_rx;
+
 	return 0;
 }
 
-static int pcnet_dummy_start_xmit(struct sk_buff *skb, struct net_device *ndev)
+/* rx-usecs is the hold-off after a poll that handled any frame, it is
+ * ignored with adaptive-rx on. Nothing else can be set.
+ */
+static int pcnet_dummy_set_coalesce(struct net_device *ndev,
+		struct ethtool_coalesce *ec)
 {
+	struct pcnet_private *pp = netdev_priv(ndev);
+
+	if (ec->rx_max_coalesced_frames || ec->rx_coalesce_usecs_irq ||
+	    ec->rx_max_coalesced_frames_irq || ec->tx_coalesce_usecs ||
+	    ec->tx_max_coalesced_frames || ec->tx_coalesce_usecs_irq ||
+	    ec->tx_max_coalesced_frames_irq ||
+	    ec->stats_block_coalesce_usecs || ec->use_adaptive_tx_coalesce ||
+	    ec->pkt_rate_low || ec->rx_coalesce_usecs_low ||
+	    ec->rx_max_coalesced_frames_low || ec->tx_coalesce_usecs_low ||
+	    ec->tx_max_coalesced_frames_low || ec->pkt_rate_high ||
+	    ec->rx_coalesce_usecs_high || ec->rx_max_coalesced_frames_high ||
+	    ec->tx_coalesce_usecs_high || ec->tx_max_coalesced_frames_high ||
+	    ec->rate_sample_interval)
+		return -EOPNOTSUPP;
+	if (ec->rx_coalesce_usecs > PCNET_ITR_MAX_USECS)
+		return -EINVAL;
+
+	pp->rx_usecs = ec->rx_coalesce_usecs;
+	pp->adaptive_rx = !!ec->use_adaptive_rx_coalesce;
+
 	return 0;
 }
 
+static void pcnet_dummy_get_ringparam(struct net_device *ndev,
+		struct ethtool_ringparam *ering)
+{
+	struct pcnet_private *pp = netdev_priv(ndev);
+
+	ering->rx_max_pending = PCNET_RING_MAX;
+	ering->tx_max_pending = PCNET_RING_MAX;
+	ering->rx_pending = pp->rx_pending;
+	ering->tx_pending = pp->tx_pending;
+}
+
+/* The controller takes ring sizes as powers of two. On a running
+ * interface the new rings and init block are allocated first, so a
+ * failure leaves the old ones working. Only then is the controller
+ * stopped and reinitialized with the new rings, which drops the frames
+ * in flight. If the initialization times out, the controller is reset
+ * and tried once more, NAPI and the queue are restarted either way.
+ */
+static int pcnet_dummy_set_ringparam(struct net_device *ndev,
+		struct ethtool_ringparam *ering)
+{
+	struct pcnet_private *pp = netdev_priv(ndev);
+	struct pcnet_dummy_init_block *ib;
+	struct pcnet_rx_ring rx;
+	struct pcnet_tx_ring tx;
+	dma_addr_t ib_dma;
+	unsigned int rx_size;
+	unsigned int tx_size;
+	int rc;
+
+	if (ering->rx_mini_pending || ering->rx_jumbo_pending ||
+	    !ering->rx_pending || !ering->tx_pending)
+		return -EINVAL;
+
+	if (ering->rx_pending > PCNET_RING_MAX ||
+	    ering->tx_pending > PCNET_RING_MAX)
+		return -EINVAL;
+
+	rx_size = max_t(u32, roundup_pow_of_two(ering->rx_pending),
+			PCNET_RING_MIN);
+	tx_size = max_t(u32, roundup_pow_of_two(ering->tx_pending),
+			PCNET_RING_MIN);
+	if (rx_size == pp->rx_pending && tx_size == pp->tx_pending)
+		return 0;
+
+	if (!netif_running(ndev)) {
+		pp->rx_pending = rx_size;
+		pp->tx_pending = tx_size;
+		return 0;
+	}
+
+	ib = pcnet_dummy_alloc_rings(pp, &ib_dma, &rx, rx_size, &tx, tx_size);
+	if (!ib)
+		return -ENOMEM;
+
+	netif_tx_disable(ndev);
+	napi_disable(&pp->napi);
+	hrtimer_cancel(&pp->itr_timer);
+	del_timer_sync(&pp->tx_timer);
+	spin_lock_irq(&pp->lock);
+	pp->iena = 0;
+	write_csr(CSR0, CSR0_STOP);
+	swap(pp->init_block, ib);
+	swap(pp->init_block_dma, ib_dma);
+	swap(pp->rx, rx);
+	swap(pp->tx, tx);
+	pcnet_dummy_setup_init_block(pp);
+	rc = pcnet_dummy_init_chip(pp);
+	if (rc && !pcnet_dummy_reset(pp))
+		rc = pcnet_dummy_init_chip(pp);
+	spin_unlock_irq(&pp->lock);
+
+	/* the old rings are no longer known to the controller */
+	pcnet_dummy_free_rings(pp, ib, ib_dma, &rx, &tx);
+	netdev_reset_queue(ndev);
+	pp->rx_pending = rx_size;
+	pp->tx_pending = tx_size;
+	napi_enable(&pp->napi);
+	netif_wake_queue(ndev);
+	if (rc)
+		netdev_err(ndev, "controller initialization timed out\n");
+
+	return rc;
+}
+
+static const struct ethtool_ops pcnet_ethtool_ops = {
+	.get_link = ethtool_op_get_link,
+	.get_coalesce = pcnet_dummy_get_coalesce,
+	.set_coalesce = pcnet_dummy_set_coalesce,
+	.get_ringparam = pcnet_dummy_get_ringparam,
+	.set_ringparam = pcnet_dummy_set_ringparam,
+	.get_sset_count = pcnet_dummy_get_sset_count,
+	.get_strings = pcnet_dummy_get_strings,
+	.get_ethtool_stats = pcnet_dummy_get_ethtool_stats,
+};
+
 /* net_device_ops structure is new for 2.6.31 */
 static const struct net_device_ops pcnet_net_device_ops = {
 	.ndo_open = pcnet_dummy_open,
 	.ndo_stop = pcnet_dummy_stop,
-	.ndo_start_xmit = pcnet_dummy_start_xmit
+	.ndo_start_xmit = pcnet_dummy_start_xmit,
+	.ndo_set_rx_mode = pcnet_dummy_set_rx_mode,
+	.ndo_get_stats64 = pcnet_dummy_get_stats64,
 };
 
+/* debugfs: <debugfs>/pcnet_dummy/<pci slot>/ */
+static struct dentry *pcnet_debugfs_root;
+
+static int pcnet_dummy_regs_show(struct seq_file *m, void *v)
+{
+	struct pcnet_private *pp = m->private;
+
+	seq_printf(m, "reads:       %llu\n", pp->regs.reads);
+	seq_printf(m, "writes:      %llu\n", pp->regs.writes);
+	seq_printf(m, "rap_writes:  %llu\n", pp->regs.rap_writes);
+	seq_printf(m, "rap_skips:   %llu\n", pp->regs.rap_skips);
+	seq_printf(m, "shadow_hits: %llu\n", pp->regs.shadow_hits);
+
+	return 0;
+}
+
+static int pcnet_dummy_regs_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pcnet_dummy_regs_show, inode->i_private);
+}
+
+static const struct file_operations pcnet_dummy_regs_fops = {
+	.owner = THIS_MODULE,
+	.open = pcnet_dummy_regs_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/* Average cost of a register read in the current access mode: CSR88
+ * read again measures the RDP read, switching to CSR89 adds a RAP
+ * write. Both registers are read-only chip ID.
+ */
+static int pcnet_dummy_latency_show(struct seq_file *m, void *v)
+{
+	struct pcnet_private *pp = m->private;
+	s64 rdp_ns = 0, rap_ns = 0;
+	unsigned long flags;
+	ktime_t start;
+	unsigned int i;
+
+	/* The lock is taken per sample so interrupts are never held off
+	 * for more than a few register reads. A sample is a pair of reads,
+	 * the second one of the same or the other register.
+	 */
+	for (i = 0; i < PCNET_LATENCY_LOOPS; i++) {
+		spin_lock_irqsave(&pp->lock, flags);
+		read_csr(CSR88);
+		start = ktime_get();
+		read_csr(CSR88);
+		rdp_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+		start = ktime_get();
+		read_csr(CSR89);
+		rap_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+		spin_unlock_irqrestore(&pp->lock, flags);
+	}
+
+	seq_printf(m, "mode:        %s, %s\n", pp->mmio ? "mmio" : "pio",
+			pp->dwio ? "dword" : "word");
+	seq_printf(m, "rdp_read_ns: %lld\n",
+			div_s64(rdp_ns, PCNET_LATENCY_LOOPS));
+	seq_printf(m, "csr_read_ns: %lld\n",
+			div_s64(rap_ns, PCNET_LATENCY_LOOPS));
+
+	return 0;
+}
+
+static int pcnet_dummy_latency_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pcnet_dummy_latency_show, inode->i_private);
+}
+
+static const struct file_operations pcnet_dummy_latency_fops = {
+	.owner = THIS_MODULE,
+	.open = pcnet_dummy_latency_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/* Memory held for DMA: the coherent block with the init block and the
+ * descriptor rings, RX pages and TX bounce slots with the software ring
+ * state. Everything is allocated by ndo_open and released by ndo_stop,
+ * so a down interface shows zero.
+ */
+static int pcnet_dummy_dma_mem_show(struct seq_file *m, void *v)
+{
+	struct pcnet_private *pp = m->private;
+	size_t block = 0, rx = 0, tx = 0;
+
+	rtnl_lock();
+	if (pp->init_block) {
+		block = pcnet_dummy_block_len(pp->rx.size, pp->tx.size);
+		rx = pp->rx.size * (sizeof(*pp->rx.buf) + PAGE_SIZE);
+		tx = pp->tx.size * (sizeof(*pp->tx.buf) + PCNET_TX_BOUNCE_LEN);
+	}
+	rtnl_unlock();
+
+	seq_printf(m, "block:      %zu\n", block);
+	seq_printf(m, "rx_buffers: %zu\n", rx);
+	seq_printf(m, "tx_buffers: %zu\n", tx);
+	seq_printf(m, "total:      %zu\n", block + rx + tx);
+
+	return 0;
+}
+
+static int pcnet_dummy_dma_mem_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pcnet_dummy_dma_mem_show, inode->i_private);
+}
+
+static const struct file_operations pcnet_dummy_dma_mem_fops = {
+	.owner = THIS_MODULE,
+	.open = pcnet_dummy_dma_mem_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static void pcnet_dummy_hist_print(struct seq_file *m, const char *name,
+		const struct pcnet_hist *h)
+{
+	unsigned int i;
+
+	seq_printf(m, "%s:\n", name);
+	for (i = 0; i < PCNET_HIST_BUCKETS; i++)
+		if (h->bucket[i])
+			seq_printf(m, "  >= %8lu us: %llu\n",
+					i ? 1UL << (i - 1) : 0UL, h->bucket[i]);
+}
+
+static int pcnet_dummy_hist_show(struct seq_file *m, void *v)
+{
+	struct pcnet_private *pp = m->private;
+
+	seq_printf(m, "enabled: %d\n", pp->hist_on);
+	pcnet_dummy_hist_print(m, "tx_latency", &pp->tx_hist);
+	pcnet_dummy_hist_print(m, "rx_dwell", &pp->rx_hist);
+
+	return 0;
+}
+
+static int pcnet_dummy_hist_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pcnet_dummy_hist_show, inode->i_private);
+}
+
+/* 1 enables collection, 0 disables it, both reset the histograms */
+static ssize_t pcnet_dummy_hist_write(struct file *file,
+		const char __user *ubuf, size_t count, loff_t *ppos)
+{
+	struct seq_file *m = file->private_data;
+	struct pcnet_private *pp = m->private;
+	unsigned long flags;
+	unsigned int val;
+	int rc;
+
+	rc = kstrtouint_from_user(ubuf, count, 0, &val);
+	if (rc)
+		return rc;
+
+	rtnl_lock();
+	if (val && !pp->hist_on)
+		static_key_slow_inc(&pcnet_hist_key);
+	else if (!val && pp->hist_on)
+		static_key_slow_dec(&pcnet_hist_key);
+	spin_lock_irqsave(&pp->lock, flags);
+	pp->hist_on = !!val;
+	pp->rx_stamp = ktime_set(0, 0);
+	memset(&pp->tx_hist, 0, sizeof(pp->tx_hist));
+	memset(&pp->rx_hist, 0, sizeof(pp->rx_hist));
+	spin_unlock_irqrestore(&pp->lock, flags);
+	rtnl_unlock();
+
+	return count;
+}
+
+static const struct file_operations pcnet_dummy_hist_fops = {
+	.owner = THIS_MODULE,
+	.open = pcnet_dummy_hist_open,
+	.read = seq_read,
+	.write = pcnet_dummy_hist_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static void __devinit pcnet_dummy_debugfs_init(struct pcnet_private *pp)
+{
+	pp->debugfs = debugfs_create_dir(pci_name(pp->pci_dev),
+			pcnet_debugfs_root);
+	debugfs_create_file("regs", S_IRUGO, pp->debugfs, pp,
+			&pcnet_dummy_regs_fops);
+	debugfs_create_file("reg_latency", S_IRUSR, pp->debugfs, pp,
+			&pcnet_dummy_latency_fops);
+	debugfs_create_file("dma_mem", S_IRUGO, pp->debugfs, pp,
+			&pcnet_dummy_dma_mem_fops);
+	debugfs_create_file("latency_hist", S_IRUGO | S_IWUSR, pp->debugfs, pp,
+			&pcnet_dummy_hist_fops);
+}
+
 static int __devinit pcnet_dummy_init_netdev(struct pci_dev *pdev,
 		unsigned long ioaddr)
 {
@@ -200,6 +1904,7 @@ static int __devinit pcnet_dummy_init_netdev(struct pci_dev *pdev,
 	ndev->base_addr = ioaddr;
 	ndev->irq = irq;
 	pp->pci_dev = pdev;
+	pp->ndev = ndev;
 	pp->base = (void *)ioaddr;
 	spin_lock_init(&pp->lock);
 
@@ -209,17 +1914,40 @@ static int __devinit pcnet_dummy_init_netdev(struct pci_dev *pdev,
 	if (!is_valid_ether_addr(ndev->dev_addr))
 		random_ether_addr(ndev->dev_addr);
 
-	if (pcnet_dummy_reset((void *)ioaddr))
+	if (pcnet_dummy_detect_io_mode(pp))
 		return -ENODEV;
 
 	/* init net_dev_ops */
 	ndev->netdev_ops = &pcnet_net_device_ops;
+	ndev->ethtool_ops = &pcnet_ethtool_ops;
+	ndev->hw_features = NETIF_F_SG | NETIF_F_HW_CSUM;
+	ndev->features |= ndev->hw_features;
+	netif_napi_add(ndev, &pp->napi, pcnet_dummy_poll, PCNET_NAPI_WEIGHT);
+	setup_timer(&pp->tx_timer, pcnet_dummy_tx_timer, (unsigned long)pp);
+	hrtimer_init(&pp->itr_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	pp->itr_timer.function = pcnet_dummy_itr_timer;
+	pp->adaptive_rx = true;
+	pp->rx_pending = PCNET_RING_DEFAULT;
+	pp->tx_pending = PCNET_RING_DEFAULT;
+	pp->stats = alloc_percpu(struct pcnet_stats);
+	if (!pp->stats)
+		goto err;
 
-	if (register_netdev(ndev))
-		return -ENODEV;
-	netdev_info(ndev, "%s %pM\n", DRV_DESCRIPTION, ndev->dev_addr);
+	if (register_netdev(ndev)) {
+		free_percpu(pp->stats);
+		goto err;
+	}
+	netdev_info(ndev, "%s %pM, %s %s mode\n", DRV_DESCRIPTION,
+			ndev->dev_addr, pp->mmio ? "MMIO" : "port I/O",
+			pp->dwio ? "dword" : "word");
+	pcnet_dummy_debugfs_init(pp);
 
 	return 0;
+
+err:
+	if (!pp->dwio)
+		static_key_slow_dec(&pcnet_wio_key);
+	return -ENODEV;
 }
 
 static int __devinit pcnet_dummy_init_one(struct pci_dev *pdev,
@@ -228,11 +1956,7 @@ static int __devinit pcnet_dummy_init_one(struct pci_dev *pdev,
 	struct pcnet_private *pp;
 	struct net_device *ndev;
 	void __iomem *ioaddr;
-#ifdef USE_IO_OPS
 	int bar = 0;
-#else
-	int bar = 1;
-#endif
 
 #ifndef MODULE
 	pr_info_once("%s version %s\n", DRV_DESCRIPTION, DRV_VERSION);
@@ -252,10 +1976,21 @@ static int __devinit pcnet_dummy_init_one(struct pci_dev *pdev,
 	if (pci_request_regions(pdev, DRV_NAME))
 		goto out_netdev;
 
+	if (use_mmio && (pci_resource_flags(pdev, 1) & IORESOURCE_MEM) &&
+			pci_resource_len(pdev, 1) >= PCNET_IOSIZE_LEN)
+		bar = 1;
 	ioaddr = pci_iomap(pdev, bar, PCNET_IOSIZE_LEN);
+	if (!ioaddr && bar) {
+		dev_info(&pdev->dev,
+				"can't map memory BAR, using port I/O\n");
+		bar = 0;
+		ioaddr = pci_iomap(pdev, bar, PCNET_IOSIZE_LEN);
+	}
 	if (!ioaddr)
 		goto out_res;
 	pci_set_drvdata(pdev, ndev);
+	pp = netdev_priv(ndev);
+	pp->mmio = bar == 1;
 
 	if (pcnet_dummy_init_netdev(pdev, (unsigned long)ioaddr))
 		goto out_res_unmap;
@@ -279,8 +2014,15 @@ static void __devexit pcnet_dummy_remove_one(struct pci_dev *pdev)
 	struct pcnet_private *pp;
 
 	pp = netdev_priv(ndev);
-	pcnet_dummy_reset(pp->base);
+	debugfs_remove_recursive(pp->debugfs);
 	unregister_netdev(ndev);
+	/* nothing else touches the registers once the device is gone */
+	pcnet_dummy_reset(pp);
+	if (!pp->dwio)
+		static_key_slow_dec(&pcnet_wio_key);
+	if (pp->hist_on)
+		static_key_slow_dec(&pcnet_hist_key);
+	free_percpu(pp->stats);
 	pci_iounmap(pdev, pp->base);
 	free_netdev(ndev);
 	pci_disable_device(pdev);
@@ -300,16 +2042,24 @@ static struct pci_driver pcnet_dummy_driver = {
 
 static int __init pcnet_init(void)
 {
+	int rc;
+
 #ifdef MODULE
 	pr_info("%s version %s\n", DRV_DESCRIPTION, DRV_VERSION);
 #endif
 
-	return pci_register_driver(&pcnet_dummy_driver);
+	pcnet_debugfs_root = debugfs_create_dir(DRV_NAME, NULL);
+	rc = pci_register_driver(&pcnet_dummy_driver);
+	if (rc)
+		debugfs_remove_recursive(pcnet_debugfs_root);
+
+	return rc;
 }
 
 static void __exit pcnet_exit(void)
 {
 	pci_unregister_driver(&pcnet_dummy_driver);
+	debugfs_remove_recursive(pcnet_debugfs_root);
 }
 
 module_init(pcnet_init);
@@ -17,15 +17,139 @@ enum {
 	PCNET_RAP = 0x14,
 	PCNET_RESET16 = 0x14,
 	PCNET_RESET = 0x18,
+	PCNET_BDP16 = 0x16,
 	PCNET_BDP = 0x1C,
 };
 
+/* ring sizes are encoded as log2 in the init block (SSIZE32: max 9) */
+enum {
+	PCNET_RING_DEFAULT = 128,
+	PCNET_RING_MIN = 32,
+	PCNET_RING_MAX = 512,
+	PCNET_RX_BUF_LEN = 1536,
+	/* TX bounce slot per descriptor */
+	PCNET_TX_BOUNCE_LEN = 256,
+	PCNET_INIT_TIMEOUT = 1000,
+	/* in 10 us steps, longer than a maximum sized frame at 10 Mbit/s */
+	PCNET_SPND_TIMEOUT = 200,
+	PCNET_NAPI_WEIGHT = 64,
+	/* delay of the reclaim of the last frames of a burst */
+	PCNET_TX_RECLAIM_MSECS = 4,
+	/* register reads per reg_latency measurement */
+	PCNET_LATENCY_LOOPS = 256,
+	/* log2 buckets of the latency histograms, up to 2^22 us */
+	PCNET_HIST_BUCKETS = 24,
+};
+
+/* software interrupt moderation */
+enum {
+	PCNET_ITR_MAX_USECS = 1000,
+	/* adaptive mode: frames per poll and the resulting hold-off */
+	PCNET_ITR_LOWEST_FRAMES = 4,
+	PCNET_ITR_BULK_FRAMES = 32,
+	PCNET_ITR_LOW_USECS = 50,
+	PCNET_ITR_BULK_USECS = 200,
+};
+
 enum {
 	CSR0 = 0,
+	CSR0_INIT = 0x0001,
+	CSR0_STRT = 0x0002,
 	CSR0_STOP = 0x0004,
+	CSR0_TDMD = 0x0008,
+	CSR0_TXON = 0x0010,
+	CSR0_RXON = 0x0020,
+	CSR0_IENA = 0x0040,
+	CSR0_INTR = 0x0080,
+	CSR0_IDON = 0x0100,
+	CSR0_TINT = 0x0200,
+	CSR0_RINT = 0x0400,
+	CSR0_MERR = 0x0800,
+	CSR0_MISS = 0x1000,
+	CSR0_CERR = 0x2000,
+	CSR0_BABL = 0x4000,
+	CSR0_ERR = 0x8000,
+	/* write-one-to-clear status bits */
+	CSR0_INT_ACK = CSR0_BABL | CSR0_CERR | CSR0_MISS | CSR0_MERR |
+		CSR0_RINT | CSR0_TINT | CSR0_IDON,
+};
+
+enum {
+	CSR1 = 1,
+	CSR2 = 2,
+};
+
+enum {
+	CSR3 = 3,
+	CSR3_RINTM = 0x0400,
+	CSR3_TINTM = 0x0200,
+};
+
+enum {
+	CSR4 = 4,
+	CSR4_APAD_XMT = 0x0800,
+};
+
+enum {
+	CSR5 = 5,
+	CSR5_SPND = 0x0001,
+};
+
+/* logical address filter, CSR8 holds bits 15-0 */
+enum {
+	CSR8 = 8,
+	CSR9 = 9,
+	CSR10 = 10,
+	CSR11 = 11,
+};
+
+enum {
+	CSR15 = 15,
+	CSR15_PROM = 0x8000,
+};
+
+/* chip ID, read-only */
+enum {
+	CSR88 = 88,
+	CSR89 = 89,
 };
 
 enum {
 	BCR18 = 18,
 	BCR18_DWIO = 0x0080,
 };
+
+enum {
+	BCR20 = 20,
+	/* PCnet-PCI II software style: SSIZE32 = 1, 32-bit descriptors */
+	BCR20_SWSTYLE_PCNET_PCI = 0x0002,
+};
+
+/* status word of a descriptor (bits 31-16 of TMD1/RMD1) */
+enum {
+	DESC_OWN = 0x8000,
+	DESC_ERR = 0x4000,
+	DESC_STP = 0x0200,
+	DESC_ENP = 0x0100,
+	/* receive errors, valid when DESC_ERR is set */
+	DESC_RX_FRAM = 0x2000,
+	DESC_RX_OFLO = 0x1000,
+	DESC_RX_CRC = 0x0800,
+	DESC_RX_BUFF = 0x0400,
+	/* 4 most significant bits of BCNT must be ones */
+	DESC_BCNT_ONES = 0xf000,
+};
+
+/* TMD2 error bits */
+enum {
+	TMD2_BUFF = 0x80000000,
+	TMD2_UFLO = 0x40000000,
+	TMD2_LCOL = 0x10000000,
+	TMD2_LCAR = 0x08000000,
+	TMD2_RTRY = 0x04000000,
+};
+
+/* RMD2: message byte count including FCS */
+enum {
+	RMD2_MCNT_MASK = 0x0fff,
+};
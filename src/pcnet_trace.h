@@ -0,0 +1,101 @@
+/* pcnet_trace.h: PCNet-PCI II/III Ethernet controller driver tracepoints */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM pcnet_dummy
+
+#if !defined(_PCNET_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _PCNET_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/* frame handed to the controller, used is the TX ring occupancy after */
+TRACE_EVENT(pcnet_dummy_xmit,
+	TP_PROTO(struct net_device *ndev, unsigned int index,
+		unsigned int len, unsigned int used),
+	TP_ARGS(ndev, index, len, used),
+	TP_STRUCT__entry(
+		__string(name, ndev->name)
+		__field(unsigned int, index)
+		__field(unsigned int, len)
+		__field(unsigned int, used)
+	),
+	TP_fast_assign(
+		__assign_str(name, ndev->name);
+		__entry->index = index;
+		__entry->len = len;
+		__entry->used = used;
+	),
+	TP_printk("dev=%s index=%u len=%u used=%u", __get_str(name),
+		__entry->index, __entry->len, __entry->used)
+);
+
+/* frame passed to the stack */
+TRACE_EVENT(pcnet_dummy_rx,
+	TP_PROTO(struct net_device *ndev, unsigned int index,
+		unsigned int len),
+	TP_ARGS(ndev, index, len),
+	TP_STRUCT__entry(
+		__string(name, ndev->name)
+		__field(unsigned int, index)
+		__field(unsigned int, len)
+	),
+	TP_fast_assign(
+		__assign_str(name, ndev->name);
+		__entry->index = index;
+		__entry->len = len;
+	),
+	TP_printk("dev=%s index=%u len=%u", __get_str(name),
+		__entry->index, __entry->len)
+);
+
+/* CSR0 as read on entry to the ISR, before it is acknowledged */
+TRACE_EVENT(pcnet_dummy_irq,
+	TP_PROTO(struct net_device *ndev, u32 csr0),
+	TP_ARGS(ndev, csr0),
+	TP_STRUCT__entry(
+		__string(name, ndev->name)
+		__field(u32, csr0)
+	),
+	TP_fast_assign(
+		__assign_str(name, ndev->name);
+		__entry->csr0 = csr0;
+	),
+	/* literal bit values, userspace tools can't resolve the enums */
+	TP_printk("dev=%s csr0=0x%04x %s", __get_str(name), __entry->csr0,
+		__print_flags(__entry->csr0, "|",
+			{ 0x8000, "ERR" }, { 0x4000, "BABL" },
+			{ 0x2000, "CERR" }, { 0x1000, "MISS" },
+			{ 0x0800, "MERR" }, { 0x0400, "RINT" },
+			{ 0x0200, "TINT" }, { 0x0100, "IDON" },
+			{ 0x0080, "INTR" }, { 0x0040, "IENA" }))
+);
+
+/* one reclaim pass, used is the TX ring occupancy after */
+TRACE_EVENT(pcnet_dummy_tx_reclaim,
+	TP_PROTO(struct net_device *ndev, unsigned int frames,
+		unsigned int bytes, unsigned int used),
+	TP_ARGS(ndev, frames, bytes, used),
+	TP_STRUCT__entry(
+		__string(name, ndev->name)
+		__field(unsigned int, frames)
+		__field(unsigned int, bytes)
+		__field(unsigned int, used)
+	),
+	TP_fast_assign(
+		__assign_str(name, ndev->name);
+		__entry->frames = frames;
+		__entry->bytes = bytes;
+		__entry->used = used;
+	),
+	TP_printk("dev=%s frames=%u bytes=%u used=%u", __get_str(name),
+		__entry->frames, __entry->bytes, __entry->used)
+);
+
+#endif /* _PCNET_TRACE_H */
+
+/* the header is not in include/trace/events */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE pcnet_trace
+#include <trace/define_trace.h>
@@ -0,0 +1,1079 @@
+/* kshim.c: userspace implementation of the kernel API in kshim.h */
+
+#include <stdarg.h>
+
+#include "kshim.h"
+
+struct kshim_state kshim;
+
+unsigned long jiffies;
+s64 kshim_now_ns;
+int kshim_irqs_off;
+s64 kshim_irqoff_max_ns;
+static s64 kshim_irqoff_start;
+static int kshim_locks;
+
+static struct pci_dev *kshim_pci_list;
+static struct pci_driver *kshim_pci_driver;
+static unsigned int kshim_next_irq = 10;
+
+static struct napi_struct *kshim_poll_list;
+static struct timer_list *kshim_timer_list;
+static struct hrtimer *kshim_hrtimer_list;
+
+#define KSHIM_NR_IRQS	64
+
+static struct {
+	irqreturn_t (*handler)(int, void *);
+	void *dev_id;
+} kshim_irq_line[KSHIM_NR_IRQS];
+
+void kshim_log(int level, const char *fmt)
+{
+	static const char *const names[] = { "err", "warn", "info" };
+
+	kshim.messages[level]++;
+	if (getenv("KSHIM_VERBOSE"))
+		fprintf(stderr, "kernel %s: %s", names[level], fmt);
+}
+
+void kshim_bug(const char *what, const char *file, int line)
+{
+	kshim.bugs++;
+	fprintf(stderr, "BUG: %s at %s:%d\n", what, file, line);
+}
+
+/* counts down *n, true when it reaches zero */
+static bool kshim_fail(unsigned int *n)
+{
+	return *n && !--*n;
+}
+
+/*
+ * Time, locks and interrupts
+ */
+
+static void kshim_irqoff_enter(void)
+{
+	if (!kshim_irqs_off++)
+		kshim_irqoff_start = kshim_now_ns;
+}
+
+static void kshim_irqoff_exit(void)
+{
+	KSHIM_BUG_ON(kshim_irqs_off <= 0);
+	if (!--kshim_irqs_off && kshim_now_ns - kshim_irqoff_start >
+			kshim_irqoff_max_ns)
+		kshim_irqoff_max_ns = kshim_now_ns - kshim_irqoff_start;
+}
+
+static void kshim_set_time(s64 ns)
+{
+	kshim_now_ns = ns;
+	jiffies = ns / (NSEC_PER_SEC / HZ);
+}
+
+void udelay(unsigned long usecs)
+{
+	struct pci_dev *pdev;
+
+	kshim_set_time(kshim_now_ns + usecs * NSEC_PER_USEC);
+	for (pdev = kshim_pci_list; pdev; pdev = pdev->next)
+		if (pdev->ops->delay)
+			pdev->ops->delay(pdev->opaque, usecs);
+}
+
+void kshim_spin_lock(spinlock_t *l, bool irq)
+{
+	/* one CPU: a held lock can't be released by anyone else */
+	KSHIM_BUG_ON(l->locked);
+	if (irq)
+		kshim_irqoff_enter();
+	l->locked = 1;
+	kshim_locks++;
+}
+
+void kshim_spin_unlock(spinlock_t *l, bool irq)
+{
+	KSHIM_BUG_ON(!l->locked);
+	l->locked = 0;
+	kshim_locks--;
+	if (irq)
+		kshim_irqoff_exit();
+}
+
+void rtnl_lock(void)
+{
+	KSHIM_BUG_ON(kshim.rtnl);
+	kshim.rtnl = 1;
+}
+
+void rtnl_unlock(void)
+{
+	KSHIM_BUG_ON(!kshim.rtnl);
+	kshim.rtnl = 0;
+}
+
+int request_irq(unsigned int irq, irqreturn_t (*handler)(int, void *),
+		unsigned long flags, const char *name, void *dev_id)
+{
+	KSHIM_BUG_ON(irq >= KSHIM_NR_IRQS || kshim_irq_line[irq].handler);
+	kshim_irq_line[irq].handler = handler;
+	kshim_irq_line[irq].dev_id = dev_id;
+	return 0;
+}
+
+void free_irq(unsigned int irq, void *dev_id)
+{
+	KSHIM_BUG_ON(irq >= KSHIM_NR_IRQS || !kshim_irq_line[irq].handler ||
+			kshim_irq_line[irq].dev_id != dev_id);
+	kshim_irq_line[irq].handler = NULL;
+	kshim_irq_line[irq].dev_id = NULL;
+}
+
+/*
+ * Timers
+ */
+
+void setup_timer(struct timer_list *timer, void (*fn)(unsigned long),
+		unsigned long data)
+{
+	memset(timer, 0, sizeof(*timer));
+	timer->function = fn;
+	timer->data = data;
+}
+
+int mod_timer(struct timer_list *timer, unsigned long expires)
+{
+	int was = timer->pending;
+
+	if (!was) {
+		timer->next = kshim_timer_list;
+		kshim_timer_list = timer;
+		timer->pending = true;
+		kshim.timers++;
+	}
+	timer->expires = expires;
+	return was;
+}
+
+int del_timer_sync(struct timer_list *timer)
+{
+	struct timer_list **p;
+
+	if (!timer->pending)
+		return 0;
+	for (p = &kshim_timer_list; *p != timer; p = &(*p)->next)
+		;
+	*p = timer->next;
+	timer->pending = false;
+	kshim.timers--;
+	return 1;
+}
+
+void hrtimer_init(struct hrtimer *timer, int clock, enum hrtimer_mode mode)
+{
+	memset(timer, 0, sizeof(*timer));
+}
+
+int hrtimer_cancel(struct hrtimer *timer)
+{
+	struct hrtimer **p;
+
+	if (!timer->active)
+		return 0;
+	for (p = &kshim_hrtimer_list; *p != timer; p = &(*p)->next)
+		;
+	*p = timer->next;
+	timer->active = false;
+	kshim.timers--;
+	return 1;
+}
+
+int hrtimer_start(struct hrtimer *timer, ktime_t delay,
+		enum hrtimer_mode mode)
+{
+	int was = hrtimer_cancel(timer);
+
+	timer->expires = kshim_now_ns + delay;
+	timer->next = kshim_hrtimer_list;
+	kshim_hrtimer_list = timer;
+	timer->active = true;
+	kshim.timers++;
+	return was;
+}
+
+static s64 kshim_timer_ns(const struct timer_list *timer)
+{
+	return (s64)timer->expires * (NSEC_PER_SEC / HZ);
+}
+
+/* fires the earliest timer due by 'until', false if there is none */
+static bool kshim_fire_one(s64 until)
+{
+	struct timer_list *t, *first = NULL;
+	struct hrtimer *h, *hfirst = NULL;
+
+	for (t = kshim_timer_list; t; t = t->next)
+		if (!first || kshim_timer_ns(t) < kshim_timer_ns(first))
+			first = t;
+	for (h = kshim_hrtimer_list; h; h = h->next)
+		if (!hfirst || h->expires < hfirst->expires)
+			hfirst = h;
+
+	if (first && kshim_timer_ns(first) <= until &&
+			(!hfirst || kshim_timer_ns(first) <= hfirst->expires)) {
+		if (kshim_timer_ns(first) > kshim_now_ns)
+			kshim_set_time(kshim_timer_ns(first));
+		del_timer_sync(first);
+		first->function(first->data);
+		return true;
+	}
+	if (hfirst && hfirst->expires <= until) {
+		if (hfirst->expires > kshim_now_ns)
+			kshim_set_time(hfirst->expires);
+		hrtimer_cancel(hfirst);
+		/* hrtimer callbacks run with interrupts off */
+		kshim_irqoff_enter();
+		KSHIM_BUG_ON(hfirst->function(hfirst) != HRTIMER_NORESTART);
+		kshim_irqoff_exit();
+		return true;
+	}
+	return false;
+}
+
+void kshim_advance(s64 ns)
+{
+	s64 until = kshim_now_ns + ns;
+
+	kshim_run();
+	while (kshim_fire_one(until))
+		kshim_run();
+	kshim_set_time(until);
+}
+
+/*
+ * Memory, pages and DMA
+ */
+
+void *kmalloc(size_t size, gfp_t gfp)
+{
+	void *p;
+
+	if (kshim_fail(&kshim.fail_kmalloc))
+		return NULL;
+	p = malloc(size);
+	if (p)
+		kshim.allocs++;
+	return p;
+}
+
+void *kcalloc(size_t n, size_t size, gfp_t gfp)
+{
+	void *p = kmalloc(n * size, gfp);
+
+	if (p)
+		memset(p, 0, n * size);
+	return p;
+}
+
+void kfree(const void *p)
+{
+	if (!p)
+		return;
+	kshim.allocs--;
+	free((void *)p);
+}
+
+/* The page contents are followed by the struct page, within one block
+ * aligned to twice the page size.
+ */
+struct page *alloc_page(gfp_t gfp)
+{
+	struct page *page;
+	void *addr;
+
+	if (kshim_fail(&kshim.fail_alloc_page))
+		return NULL;
+	addr = aligned_alloc(2 * PAGE_SIZE, 2 * PAGE_SIZE);
+	if (!addr)
+		return NULL;
+	page = (struct page *)((char *)addr + PAGE_SIZE);
+	page->addr = addr;
+	page->count = 1;
+	kshim.pages++;
+	return page;
+}
+
+struct page *virt_to_page(const void *addr)
+{
+	uintptr_t base = (uintptr_t)addr & ~(2 * PAGE_SIZE - 1);
+
+	return (struct page *)(base + PAGE_SIZE);
+}
+
+void get_page(struct page *page)
+{
+	KSHIM_BUG_ON(page->count <= 0);
+	page->count++;
+}
+
+void put_page(struct page *page)
+{
+	KSHIM_BUG_ON(page->count <= 0);
+	if (--page->count)
+		return;
+	kshim.pages--;
+	free(page->addr);
+}
+
+/* Bus addresses are translated page by page, like an IOMMU would.
+ * Page 0 is never handed out, so 0 can be the mapping error. A mapping
+ * remembers its page count in its first entry to catch unmaps that
+ * don't match the map.
+ */
+#define KSHIM_IOVA_PAGES	(1U << 20)
+
+static uintptr_t kshim_iova[KSHIM_IOVA_PAGES];
+static unsigned int kshim_iova_len[KSHIM_IOVA_PAGES];
+static unsigned int kshim_iova_next = 1;
+
+static dma_addr_t kshim_iova_map(void *cpu, size_t size)
+{
+	uintptr_t addr = (uintptr_t)cpu;
+	unsigned int n = (addr % PAGE_SIZE + size + PAGE_SIZE - 1) / PAGE_SIZE;
+	unsigned int start, i, tries;
+
+	for (tries = 0; tries < KSHIM_IOVA_PAGES; tries++) {
+		start = kshim_iova_next;
+		if (start + n > KSHIM_IOVA_PAGES) {
+			kshim_iova_next = 1;
+			continue;
+		}
+		for (i = 0; i < n && !kshim_iova[start + i]; i++)
+			;
+		if (i == n)
+			break;
+		kshim_iova_next = start + i + 1;
+	}
+	if (tries == KSHIM_IOVA_PAGES)
+		return 0;
+
+	for (i = 0; i < n; i++)
+		kshim_iova[start + i] = (addr & ~(PAGE_SIZE - 1)) +
+			i * PAGE_SIZE;
+	kshim_iova_len[start] = n;
+	kshim_iova_next = start + n;
+	kshim.dma_maps++;
+	return (dma_addr_t)start * PAGE_SIZE + addr % PAGE_SIZE;
+}
+
+static void kshim_iova_unmap(dma_addr_t dma, size_t size)
+{
+	unsigned int start = dma / PAGE_SIZE;
+	unsigned int n = (dma % PAGE_SIZE + size + PAGE_SIZE - 1) / PAGE_SIZE;
+	unsigned int i;
+
+	KSHIM_BUG_ON(dma >= (dma_addr_t)KSHIM_IOVA_PAGES * PAGE_SIZE);
+	KSHIM_BUG_ON(!kshim_iova[start] || kshim_iova_len[start] != n);
+	if (kshim_iova_len[start] != n)
+		return;
+	for (i = 0; i < n; i++)
+		kshim_iova[start + i] = 0;
+	kshim_iova_len[start] = 0;
+	kshim.dma_maps--;
+}
+
+void *kshim_dma_ptr(dma_addr_t dma, size_t len)
+{
+	unsigned int start = dma / PAGE_SIZE;
+	unsigned int n = (dma % PAGE_SIZE + len + PAGE_SIZE - 1) / PAGE_SIZE;
+	unsigned int i;
+
+	if (!len || start + n > KSHIM_IOVA_PAGES || !kshim_iova[start])
+		return NULL;
+	for (i = 1; i < n; i++)
+		if (kshim_iova[start + i] != kshim_iova[start] + i * PAGE_SIZE)
+			return NULL;
+	return (void *)(kshim_iova[start] + dma % PAGE_SIZE);
+}
+
+void *dma_alloc_coherent(struct device *dev, size_t size,
+		dma_addr_t *dma, gfp_t gfp)
+{
+	size_t len = ALIGN(size, PAGE_SIZE);
+	void *cpu;
+
+	if (kshim_fail(&kshim.fail_coherent))
+		return NULL;
+	cpu = aligned_alloc(PAGE_SIZE, len);
+	if (!cpu)
+		return NULL;
+	*dma = kshim_iova_map(cpu, len);
+	if (!*dma) {
+		free(cpu);
+		return NULL;
+	}
+	kshim.allocs++;
+	return cpu;
+}
+
+void dma_free_coherent(struct device *dev, size_t size, void *cpu,
+		dma_addr_t dma)
+{
+	KSHIM_BUG_ON(kshim_dma_ptr(dma, size) != cpu);
+	kshim_iova_unmap(dma, ALIGN(size, PAGE_SIZE));
+	kshim.allocs--;
+	free(cpu);
+}
+
+dma_addr_t dma_map_single(struct device *dev, void *cpu, size_t size,
+		enum dma_data_direction dir)
+{
+	if (kshim_fail(&kshim.fail_dma_map))
+		return 0;
+	return kshim_iova_map(cpu, size);
+}
+
+void dma_unmap_single(struct device *dev, dma_addr_t dma, size_t size,
+		enum dma_data_direction dir)
+{
+	kshim_iova_unmap(dma, size);
+}
+
+dma_addr_t dma_map_page(struct device *dev, struct page *page,
+		unsigned long offset, size_t size, enum dma_data_direction dir)
+{
+	return dma_map_single(dev, (char *)page->addr + offset, size, dir);
+}
+
+/*
+ * skbs
+ */
+
+static struct sk_buff *kshim_skb_new(void)
+{
+	struct sk_buff *skb = calloc(1, sizeof(*skb));
+
+	if (skb)
+		kshim.skbs++;
+	return skb;
+}
+
+/* a linear skb with NET_SKB_PAD of headroom */
+struct sk_buff *kshim_alloc_skb(unsigned int len)
+{
+	struct sk_buff *skb = kshim_skb_new();
+
+	if (!skb)
+		return NULL;
+	skb->head = malloc(NET_SKB_PAD + len);
+	if (!skb->head) {
+		free(skb);
+		kshim.skbs--;
+		return NULL;
+	}
+	skb->data = skb->head + NET_SKB_PAD;
+	return skb;
+}
+
+struct sk_buff *netdev_alloc_skb_ip_align(struct net_device *ndev,
+		unsigned int len)
+{
+	struct sk_buff *skb = kshim_alloc_skb(NET_IP_ALIGN + len);
+
+	if (skb) {
+		skb_reserve(skb, NET_IP_ALIGN);
+		skb->dev = ndev;
+	}
+	return skb;
+}
+
+struct sk_buff *build_skb(void *data, unsigned int frag_size)
+{
+	struct sk_buff *skb = kshim_skb_new();
+
+	if (!skb)
+		return NULL;
+	skb->head = data;
+	skb->data = data;
+	skb->head_frag = true;
+	return skb;
+}
+
+static void kshim_free_skb(struct sk_buff *skb)
+{
+	unsigned int i;
+
+	if (!skb)
+		return;
+	if (skb->head_frag)
+		put_page(virt_to_page(skb->head));
+	else
+		free(skb->head);
+	for (i = 0; i < skb->shinfo.nr_frags; i++)
+		put_page(skb->shinfo.frags[i].page);
+	kshim.skbs--;
+	free(skb);
+}
+
+void kfree_skb(struct sk_buff *skb)
+{
+	if (skb)
+		kshim.skbs_dropped++;
+	kshim_free_skb(skb);
+}
+
+void consume_skb(struct sk_buff *skb)
+{
+	if (skb)
+		kshim.skbs_consumed++;
+	kshim_free_skb(skb);
+}
+
+int skb_copy_bits(const struct sk_buff *skb, int offset, void *to, int len)
+{
+	const skb_frag_t *frag;
+	unsigned int i, n;
+	u8 *dst = to;
+
+	if (offset < 0 || len < 0 || (unsigned int)(offset + len) > skb->len)
+		return -EINVAL;
+	n = min((unsigned int)len, skb_headlen(skb) > (unsigned int)offset ?
+			skb_headlen(skb) - offset : 0);
+	memcpy(dst, skb->data + offset, n);
+	dst += n;
+	len -= n;
+	offset = max(0, offset - (int)skb_headlen(skb));
+	for (i = 0; len && i < skb->shinfo.nr_frags; i++) {
+		frag = &skb->shinfo.frags[i];
+		if ((unsigned int)offset >= frag->size) {
+			offset -= frag->size;
+			continue;
+		}
+		n = min((unsigned int)len, frag->size - offset);
+		memcpy(dst, (u8 *)frag->page->addr + frag->page_offset +
+				offset, n);
+		dst += n;
+		len -= n;
+		offset = 0;
+	}
+	return 0;
+}
+
+/*
+ * Network devices
+ */
+
+struct net_device *alloc_etherdev(int sizeof_priv)
+{
+	size_t len = ALIGN(sizeof(struct net_device), L1_CACHE_BYTES) +
+		sizeof_priv;
+	struct net_device *ndev;
+
+	ndev = aligned_alloc(L1_CACHE_BYTES, ALIGN(len, L1_CACHE_BYTES));
+	if (!ndev)
+		return NULL;
+	memset(ndev, 0, len);
+	strcpy(ndev->name, "eth%d");
+	/* no BQL limit unless a test sets one */
+	ndev->txq.limit = ~0U;
+	kshim.allocs++;
+	return ndev;
+}
+
+void free_netdev(struct net_device *ndev)
+{
+	struct napi_struct **p = &kshim_poll_list;
+
+	kshim_rx_purge(ndev);
+	while (*p) {
+		if ((*p)->dev == ndev)
+			*p = (*p)->next;
+		else
+			p = &(*p)->next;
+	}
+	kshim.allocs--;
+	free(ndev);
+}
+
+int register_netdev(struct net_device *ndev)
+{
+	static unsigned int n;
+
+	snprintf(ndev->name, sizeof(ndev->name), "sim%u", n++);
+	return 0;
+}
+
+void unregister_netdev(struct net_device *ndev)
+{
+	if (netif_running(ndev))
+		kshim_dev_close(ndev);
+}
+
+void netdev_stats_to_stats64(struct rtnl_link_stats64 *stats64,
+		const struct net_device_stats *stats)
+{
+	const unsigned long *src = (const unsigned long *)stats;
+	u64 *dst = (u64 *)stats64;
+	size_t i;
+
+	BUILD_BUG_ON(sizeof(*stats) / sizeof(long) !=
+			sizeof(*stats64) / sizeof(u64));
+	for (i = 0; i < sizeof(*stats) / sizeof(long); i++)
+		dst[i] = src[i];
+}
+
+void netdev_sent_queue(struct net_device *ndev, unsigned int bytes)
+{
+	ndev->txq.inflight += bytes;
+	if (ndev->txq.inflight > ndev->txq.limit)
+		__set_bit(__QUEUE_STATE_STACK_XOFF, &ndev->txq.state);
+}
+
+void netdev_completed_queue(struct net_device *ndev, unsigned int pkts,
+		unsigned int bytes)
+{
+	if (!bytes)
+		return;
+	KSHIM_BUG_ON(bytes > ndev->txq.inflight);
+	ndev->txq.inflight -= bytes;
+	if (ndev->txq.inflight <= ndev->txq.limit &&
+			test_bit(__QUEUE_STATE_STACK_XOFF, &ndev->txq.state)) {
+		__clear_bit(__QUEUE_STATE_STACK_XOFF, &ndev->txq.state);
+		ndev->txq.wakeups++;
+	}
+}
+
+void netdev_reset_queue(struct net_device *ndev)
+{
+	__clear_bit(__QUEUE_STATE_STACK_XOFF, &ndev->txq.state);
+	ndev->txq.inflight = 0;
+}
+
+int kshim_dev_open(struct net_device *ndev)
+{
+	int rc;
+
+	rtnl_lock();
+	rc = ndev->netdev_ops->ndo_open(ndev);
+	if (!rc) {
+		__set_bit(KSHIM_LINK_START, &ndev->state);
+		if (ndev->netdev_ops->ndo_set_rx_mode)
+			ndev->netdev_ops->ndo_set_rx_mode(ndev);
+	}
+	rtnl_unlock();
+	return rc;
+}
+
+void kshim_dev_close(struct net_device *ndev)
+{
+	bool locked = kshim.rtnl;
+
+	if (!locked)
+		rtnl_lock();
+	__clear_bit(KSHIM_LINK_START, &ndev->state);
+	ndev->netdev_ops->ndo_stop(ndev);
+	if (!locked)
+		rtnl_unlock();
+}
+
+/* the skb stays with the caller if the queue is stopped */
+netdev_tx_t kshim_xmit(struct net_device *ndev, struct sk_buff *skb)
+{
+	netdev_tx_t rc;
+
+	KSHIM_BUG_ON(!netif_running(ndev));
+	if (netif_xmit_stopped(&ndev->txq))
+		return NETDEV_TX_BUSY;
+	rc = ndev->netdev_ops->ndo_start_xmit(skb, ndev);
+	KSHIM_BUG_ON(kshim_locks || kshim_irqs_off);
+	return rc;
+}
+
+struct sk_buff *kshim_rx_pop(struct net_device *ndev)
+{
+	struct sk_buff *skb = ndev->rx_head;
+
+	if (skb) {
+		ndev->rx_head = skb->next;
+		if (!ndev->rx_head)
+			ndev->rx_tail = NULL;
+		ndev->rx_count--;
+		skb->next = NULL;
+	}
+	return skb;
+}
+
+void kshim_rx_purge(struct net_device *ndev)
+{
+	struct sk_buff *skb;
+
+	while ((skb = kshim_rx_pop(ndev)))
+		consume_skb(skb);
+}
+
+/*
+ * NAPI
+ */
+
+void netif_napi_add(struct net_device *ndev, struct napi_struct *napi,
+		int (*poll)(struct napi_struct *, int), int weight)
+{
+	memset(napi, 0, sizeof(*napi));
+	napi->dev = ndev;
+	napi->poll = poll;
+	napi->weight = weight;
+	/* disabled until napi_enable() */
+	__set_bit(NAPI_STATE_SCHED, &napi->state);
+}
+
+bool napi_schedule_prep(struct napi_struct *napi)
+{
+	if (test_bit(NAPI_STATE_DISABLE, &napi->state) ||
+			test_bit(NAPI_STATE_SCHED, &napi->state))
+		return false;
+	__set_bit(NAPI_STATE_SCHED, &napi->state);
+	return true;
+}
+
+void __napi_schedule(struct napi_struct *napi)
+{
+	struct napi_struct **p;
+
+	KSHIM_BUG_ON(!test_bit(NAPI_STATE_SCHED, &napi->state));
+	if (napi->listed)
+		return;
+	for (p = &kshim_poll_list; *p; p = &(*p)->next)
+		;
+	napi->next = NULL;
+	*p = napi;
+	napi->listed = true;
+}
+
+void napi_complete(struct napi_struct *napi)
+{
+	KSHIM_BUG_ON(!test_bit(NAPI_STATE_SCHED, &napi->state));
+	if (kshim.napi_complete_hook)
+		kshim.napi_complete_hook(napi);
+	__clear_bit(NAPI_STATE_SCHED, &napi->state);
+}
+
+static void kshim_napi_unlist(struct napi_struct *napi)
+{
+	struct napi_struct **p;
+
+	for (p = &kshim_poll_list; *p != napi; p = &(*p)->next)
+		;
+	*p = napi->next;
+	napi->listed = false;
+}
+
+/* one round of net_rx_action() for 'napi' */
+static void kshim_napi_poll(struct napi_struct *napi)
+{
+	int work;
+
+	KSHIM_BUG_ON(kshim_locks || kshim_irqs_off);
+	work = napi->poll(napi, napi->weight);
+	KSHIM_BUG_ON(work > napi->weight);
+	KSHIM_BUG_ON(kshim_locks || kshim_irqs_off);
+	if (work == napi->weight &&
+			test_bit(NAPI_STATE_DISABLE, &napi->state))
+		napi_complete(napi);
+	/* below the weight the driver must have completed */
+	KSHIM_BUG_ON(work < napi->weight &&
+			test_bit(NAPI_STATE_SCHED, &napi->state));
+	if (!test_bit(NAPI_STATE_SCHED, &napi->state))
+		kshim_napi_unlist(napi);
+}
+
+void napi_enable(struct napi_struct *napi)
+{
+	KSHIM_BUG_ON(!test_bit(NAPI_STATE_SCHED, &napi->state));
+	if (kshim.napi_complete_hook)
+		kshim.napi_complete_hook(napi);
+	__clear_bit(NAPI_STATE_SCHED, &napi->state);
+}
+
+/* a pending poll runs to completion first, as it would on another CPU */
+void napi_disable(struct napi_struct *napi)
+{
+	__set_bit(NAPI_STATE_DISABLE, &napi->state);
+	while (napi->listed)
+		kshim_napi_poll(napi);
+	/* disabled twice, this would wait forever */
+	KSHIM_BUG_ON(test_bit(NAPI_STATE_SCHED, &napi->state));
+	__set_bit(NAPI_STATE_SCHED, &napi->state);
+	__clear_bit(NAPI_STATE_DISABLE, &napi->state);
+}
+
+int napi_gro_receive(struct napi_struct *napi, struct sk_buff *skb)
+{
+	struct net_device *ndev = napi->dev;
+
+	KSHIM_BUG_ON(kshim_locks || kshim_irqs_off);
+	skb->next = NULL;
+	if (ndev->rx_tail)
+		ndev->rx_tail->next = skb;
+	else
+		ndev->rx_head = skb;
+	ndev->rx_tail = skb;
+	ndev->rx_count++;
+	return 0;
+}
+
+/* Hard interrupts first, as long as a line is active, then one NAPI
+ * poll, until neither is left.
+ */
+bool kshim_irq(struct pci_dev *pdev)
+{
+	irqreturn_t ret;
+
+	if (!kshim_irq_line[pdev->irq].handler ||
+			!pdev->ops->irq(pdev->opaque))
+		return false;
+	kshim_irqoff_enter();
+	ret = kshim_irq_line[pdev->irq].handler(pdev->irq,
+			kshim_irq_line[pdev->irq].dev_id);
+	kshim_irqoff_exit();
+	/* nobody else shares the line, this would storm */
+	KSHIM_BUG_ON(ret == IRQ_NONE);
+	return ret == IRQ_HANDLED;
+}
+
+void kshim_run(void)
+{
+	struct pci_dev *pdev;
+	unsigned int rounds;
+	bool busy;
+
+	for (rounds = 0; rounds < 1000000; rounds++) {
+		busy = false;
+		for (pdev = kshim_pci_list; pdev; pdev = pdev->next) {
+			if (!kshim_irq(pdev))
+				continue;
+			busy = true;
+		}
+		if (kshim_poll_list) {
+			kshim_napi_poll(kshim_poll_list);
+			busy = true;
+		}
+		if (!busy)
+			return;
+	}
+	KSHIM_BUG_ON(rounds == 1000000);
+}
+
+/*
+ * ethtool, crc32, debugfs and seq_file
+ */
+
+u32 ether_crc_le(int len, const unsigned char *p)
+{
+	u32 crc = ~0U;
+	int i;
+
+	while (len--) {
+		crc ^= *p++;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ (crc & 1 ? 0xedb88320 : 0);
+	}
+	return crc;
+}
+
+static char kshim_dentry;
+
+struct dentry *debugfs_create_dir(const char *name, struct dentry *parent)
+{
+	return (struct dentry *)&kshim_dentry;
+}
+
+struct dentry *debugfs_create_file(const char *name, unsigned int mode,
+		struct dentry *parent, void *data,
+		const struct file_operations *fops)
+{
+	return (struct dentry *)&kshim_dentry;
+}
+
+int seq_printf(struct seq_file *m, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vfprintf(m->f, fmt, ap);
+	va_end(ap);
+	return 0;
+}
+
+/* the output goes to stdout */
+int single_open(struct file *file, int (*show)(struct seq_file *, void *),
+		void *data)
+{
+	struct seq_file *m = kcalloc(1, sizeof(*m), GFP_KERNEL);
+
+	if (!m)
+		return -ENOMEM;
+	m->f = stdout;
+	m->private = data;
+	file->private_data = m;
+	return show(m, NULL);
+}
+
+int single_release(struct inode *inode, struct file *file)
+{
+	kfree(file->private_data);
+	return 0;
+}
+
+ssize_t seq_read(struct file *file, char __user *buf, size_t len,
+		loff_t *ppos)
+{
+	return 0;
+}
+
+loff_t seq_lseek(struct file *file, loff_t off, int whence)
+{
+	return 0;
+}
+
+int kstrtouint_from_user(const char __user *s, size_t count,
+		unsigned int base, unsigned int *res)
+{
+	char buf[32], *end;
+
+	count = min(count, sizeof(buf) - 1);
+	memcpy(buf, s, count);
+	buf[count] = 0;
+	*res = strtoul(buf, &end, base);
+	if (end == buf || (*end && *end != '\n'))
+		return -EINVAL;
+	return 0;
+}
+
+/*
+ * PCI
+ */
+
+struct pci_dev *kshim_pci_create(const struct kshim_pci_ops *ops,
+		void *opaque)
+{
+	struct pci_dev *pdev = calloc(1, sizeof(*pdev));
+
+	if (!pdev)
+		return NULL;
+	pdev->ops = ops;
+	pdev->opaque = opaque;
+	pdev->irq = kshim_next_irq++ % KSHIM_NR_IRQS;
+	snprintf(pdev->name, sizeof(pdev->name), "0000:00:%02x.0",
+			pdev->irq);
+	pdev->resource[0].flags = IORESOURCE_IO;
+	pdev->resource[0].len = KSHIM_IO_WINDOW;
+	pdev->resource[1].flags = IORESOURCE_MEM;
+	pdev->resource[1].len = KSHIM_IO_WINDOW;
+	pdev->next = kshim_pci_list;
+	kshim_pci_list = pdev;
+	return pdev;
+}
+
+void kshim_pci_destroy(struct pci_dev *pdev)
+{
+	struct pci_dev **p;
+
+	for (p = &kshim_pci_list; *p != pdev; p = &(*p)->next)
+		;
+	*p = pdev->next;
+	free(pdev);
+}
+
+int pci_register_driver(struct pci_driver *drv)
+{
+	kshim_pci_driver = drv;
+	return 0;
+}
+
+void pci_unregister_driver(struct pci_driver *drv)
+{
+	KSHIM_BUG_ON(kshim_pci_driver != drv);
+	kshim_pci_driver = NULL;
+}
+
+int kshim_pci_probe(struct pci_dev *pdev)
+{
+	const struct pci_device_id *id = kshim_pci_driver->id_table;
+
+	return kshim_pci_driver->probe(pdev, id);
+}
+
+void kshim_pci_remove(struct pci_dev *pdev)
+{
+	kshim_pci_driver->remove(pdev);
+}
+
+void __iomem *pci_iomap(struct pci_dev *pdev, int bar, unsigned long max)
+{
+	if (bar > 1 || (bar == 1 && pdev->fail_mmio))
+		return NULL;
+	return pdev->window[bar];
+}
+
+static struct pci_dev *kshim_io_find(const void __iomem *addr,
+		unsigned int *off)
+{
+	const unsigned char *p = addr;
+	struct pci_dev *pdev;
+	int bar;
+
+	for (pdev = kshim_pci_list; pdev; pdev = pdev->next)
+		for (bar = 0; bar < 2; bar++)
+			if (p >= pdev->window[bar] &&
+					p < pdev->window[bar] + KSHIM_IO_WINDOW) {
+				*off = p - pdev->window[bar];
+				return pdev;
+			}
+	kshim_bug("access outside of any register window", __FILE__,
+			__LINE__);
+	return NULL;
+}
+
+static u32 kshim_io_read(void __iomem *addr, unsigned int size)
+{
+	unsigned int off;
+	struct pci_dev *pdev = kshim_io_find(addr, &off);
+
+	return pdev ? pdev->ops->read(pdev->opaque, off, size) : ~0U;
+}
+
+static void kshim_io_write(u32 val, void __iomem *addr, unsigned int size)
+{
+	unsigned int off;
+	struct pci_dev *pdev = kshim_io_find(addr, &off);
+
+	if (pdev)
+		pdev->ops->write(pdev->opaque, off, size, val);
+}
+
+u8 ioread8(void __iomem *addr)
+{
+	return kshim_io_read(addr, 1);
+}
+
+u16 ioread16(void __iomem *addr)
+{
+	return kshim_io_read(addr, 2);
+}
+
+u32 ioread32(void __iomem *addr)
+{
+	return kshim_io_read(addr, 4);
+}
+
+void iowrite16(u16 val, void __iomem *addr)
+{
+	kshim_io_write(val, addr, 2);
+}
+
+void iowrite32(u32 val, void __iomem *addr)
+{
+	kshim_io_write(val, addr, 4);
+}
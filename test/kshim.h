@@ -0,0 +1,868 @@
+/* kshim.h: the kernel API used by pcnet.c, implemented in userspace */
+/*
+ * Every <linux/...> header the driver includes is generated by the
+ * Makefile and includes this file. Only what pcnet.c needs is here, with
+ * the semantics the driver relies on: NAPI and queue state bits, BQL
+ * stopping the queue, page reference counts, streaming DMA mappings in
+ * a 32-bit bus address space the device model can resolve, and lock and
+ * interrupt-off bookkeeping the tests can check.
+ */
+
+#ifndef _KSHIM_H
+#define _KSHIM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "the descriptor accessors assume a little endian host"
+#endif
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef unsigned long long u64;
+typedef int32_t s32;
+typedef long long s64;
+typedef u16 __le16;
+typedef u32 __le32;
+typedef u16 __be16;
+typedef u64 dma_addr_t;
+typedef unsigned int gfp_t;
+typedef s64 ktime_t;
+
+#define __iomem
+#define __user
+#define __percpu
+#define __init
+#define __exit
+#define __devinit
+#define __devexit
+#define __devexit_p(x)	x
+#define __packed	__attribute__((packed))
+
+#define L1_CACHE_BYTES	64
+#define ____cacheline_aligned_in_smp	__attribute__((aligned(L1_CACHE_BYTES)))
+
+#define likely(x)	__builtin_expect(!!(x), 1)
+#define unlikely(x)	__builtin_expect(!!(x), 0)
+
+#define barrier()	__asm__ __volatile__("" : : : "memory")
+#define wmb()		__sync_synchronize()
+#define rmb()		__sync_synchronize()
+#define smp_wmb()	__sync_synchronize()
+#define smp_rmb()	__sync_synchronize()
+
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+#define ALIGN(x, a)	(((x) + (a) - 1) & ~((__typeof__(x))(a) - 1))
+#define BUILD_BUG_ON(c)	((void)sizeof(char[1 - 2 * !!(c)]))
+#define container_of(p, t, m)	((t *)((char *)(p) - offsetof(t, m)))
+
+#define min(a, b)	((a) < (b) ? (a) : (b))
+#define max(a, b)	((a) > (b) ? (a) : (b))
+#define min_t(t, a, b)	min((t)(a), (t)(b))
+#define max_t(t, a, b)	max((t)(a), (t)(b))
+#define clamp_t(t, v, lo, hi)	min_t(t, max_t(t, v, lo), hi)
+#define swap(a, b) \
+	do { __typeof__(a) __t = (a); (a) = (b); (b) = __t; } while (0)
+
+#define cpu_to_le16(x)	((u16)(x))
+#define cpu_to_le32(x)	((u32)(x))
+#define le16_to_cpu(x)	((u16)(x))
+#define le32_to_cpu(x)	((u32)(x))
+
+#define EBUSY		16
+#define ENOMEM		12
+#define ENODEV		19
+#define EINVAL		22
+#define EOPNOTSUPP	95
+#define ETIMEDOUT	110
+
+#define S_IRUGO		(S_IRUSR | S_IRGRP | S_IROTH)
+
+/* module.h, init.h */
+#define MODULE_AUTHOR(x)
+#define MODULE_DESCRIPTION(x)
+#define MODULE_VERSION(x)
+#define MODULE_LICENSE(x)
+#define MODULE_PARM_DESC(p, d)
+#define module_param(p, t, perm)
+#define THIS_MODULE	NULL
+/* the tests call the init and exit functions themselves */
+#define module_init(fn) \
+	static int (*__kshim_init)(void) __attribute__((unused)) = fn
+#define module_exit(fn) \
+	static void (*__kshim_exit)(void) __attribute__((unused)) = fn
+
+/* kernel.h, log2.h, math64.h */
+static inline int fls64(u64 x)
+{
+	return x ? 64 - __builtin_clzll(x) : 0;
+}
+
+#define ilog2(n)	(fls64(n) - 1)
+
+static inline unsigned long roundup_pow_of_two(unsigned long n)
+{
+	return 1UL << fls64(n - 1);
+}
+
+static inline s64 div_s64(s64 a, s32 b)
+{
+	return a / b;
+}
+
+static inline int test_bit(int nr, const unsigned long *addr)
+{
+	return (*addr >> nr) & 1;
+}
+
+static inline void __set_bit(int nr, unsigned long *addr)
+{
+	*addr |= 1UL << nr;
+}
+
+static inline void __clear_bit(int nr, unsigned long *addr)
+{
+	*addr &= ~(1UL << nr);
+}
+
+/* Messages are counted, and printed with KSHIM_VERBOSE set in the
+ * environment. The format is printed as is, it may use %pM.
+ */
+enum {
+	KSHIM_LOG_ERR,
+	KSHIM_LOG_WARN,
+	KSHIM_LOG_INFO,
+};
+
+void kshim_log(int level, const char *fmt);
+
+#define pr_info(fmt, ...)		kshim_log(KSHIM_LOG_INFO, fmt)
+#define pr_info_once(fmt, ...)		kshim_log(KSHIM_LOG_INFO, fmt)
+#define dev_info(dev, fmt, ...)		kshim_log(KSHIM_LOG_INFO, fmt)
+#define netdev_info(ndev, fmt, ...)	kshim_log(KSHIM_LOG_INFO, fmt)
+#define netdev_warn(ndev, fmt, ...)	kshim_log(KSHIM_LOG_WARN, fmt)
+#define netdev_err(ndev, fmt, ...)	kshim_log(KSHIM_LOG_ERR, fmt)
+
+/* Violations of the kernel API rules, e.g. a lock taken twice or NAPI
+ * enabled twice. Each one fails the running test.
+ */
+void kshim_bug(const char *what, const char *file, int line);
+#define KSHIM_BUG_ON(c) \
+	do { if (c) kshim_bug(#c, __FILE__, __LINE__); } while (0)
+
+/* time: a virtual clock, advanced by udelay() and kshim_advance() */
+#define HZ		1000
+#define NSEC_PER_USEC	1000L
+#define NSEC_PER_MSEC	1000000L
+#define NSEC_PER_SEC	1000000000L
+
+extern unsigned long jiffies;
+extern s64 kshim_now_ns;
+
+#define msecs_to_jiffies(m)	((unsigned long)(m) * HZ / 1000)
+
+static inline ktime_t ktime_get(void)
+{
+	return kshim_now_ns;
+}
+
+#define ktime_set(s, ns)	((ktime_t)(s) * NSEC_PER_SEC + (ns))
+#define ktime_to_ns(t)		((s64)(t))
+#define ns_to_ktime(ns)		((ktime_t)(ns))
+#define ktime_sub(a, b)		((a) - (b))
+#define ktime_us_delta(a, b)	(((a) - (b)) / NSEC_PER_USEC)
+
+void udelay(unsigned long usecs);
+
+/* spinlock.h: interrupts are off while any _irq/_irqsave lock is held,
+ * the longest such stretch of virtual time is kept for the tests
+ */
+typedef struct {
+	int locked;
+} spinlock_t;
+
+extern int kshim_irqs_off;
+extern s64 kshim_irqoff_max_ns;
+
+void kshim_spin_lock(spinlock_t *l, bool irq);
+void kshim_spin_unlock(spinlock_t *l, bool irq);
+
+#define spin_lock_init(l)		((l)->locked = 0)
+#define spin_lock(l)			kshim_spin_lock(l, false)
+#define spin_unlock(l)			kshim_spin_unlock(l, false)
+#define spin_lock_irq(l)		kshim_spin_lock(l, true)
+#define spin_unlock_irq(l)		kshim_spin_unlock(l, true)
+#define spin_lock_irqsave(l, f)		((f) = 0, kshim_spin_lock(l, true))
+#define spin_unlock_irqrestore(l, f)	((void)(f), kshim_spin_unlock(l, true))
+
+/* rtnetlink.h */
+void rtnl_lock(void);
+void rtnl_unlock(void);
+
+/* jump_label.h */
+struct static_key {
+	int enabled;
+};
+
+#define STATIC_KEY_INIT_FALSE	{ 0 }
+
+static inline bool static_key_false(struct static_key *key)
+{
+	return key->enabled > 0;
+}
+
+static inline void static_key_slow_inc(struct static_key *key)
+{
+	key->enabled++;
+}
+
+static inline void static_key_slow_dec(struct static_key *key)
+{
+	KSHIM_BUG_ON(key->enabled <= 0);
+	key->enabled--;
+}
+
+/* slab.h, percpu.h: a single CPU */
+#define GFP_KERNEL	0x01
+#define GFP_ATOMIC	0x02
+#define __GFP_COLD	0x04
+
+void *kmalloc(size_t size, gfp_t gfp);
+void *kcalloc(size_t n, size_t size, gfp_t gfp);
+void kfree(const void *p);
+
+#define alloc_percpu(type)	((type *)kcalloc(1, sizeof(type), GFP_KERNEL))
+#define free_percpu(p)		kfree(p)
+#define this_cpu_ptr(p)		(p)
+#define per_cpu_ptr(p, cpu)	(p)
+#define for_each_possible_cpu(cpu)	for ((cpu) = 0; (cpu) < 1; (cpu)++)
+
+/* u64_stats_sync.h: 64-bit counters are atomic here */
+struct u64_stats_sync {
+	unsigned int seq;
+};
+
+#define u64_stats_update_begin(s)	((void)(s))
+#define u64_stats_update_end(s)		((void)(s))
+#define u64_stats_fetch_begin_bh(s)	((void)(s), 0)
+#define u64_stats_fetch_retry_bh(s, start)	((void)(s), (void)(start), 0)
+
+/* mm.h: pages are refcounted, virt_to_page() works on their contents */
+#define PAGE_SIZE	4096UL
+
+struct page {
+	void *addr;
+	int count;
+};
+
+struct page *alloc_page(gfp_t gfp);
+void get_page(struct page *page);
+void put_page(struct page *page);
+struct page *virt_to_page(const void *addr);
+
+#define __free_page(page)	put_page(page)
+#define page_address(page)	((page)->addr)
+#define page_count(page)	((page)->count)
+#define page_to_nid(page)	0
+#define numa_node_id()		0
+
+/* dma-mapping.h: mappings get addresses below 4 GiB, 0 is the error */
+enum dma_data_direction {
+	DMA_BIDIRECTIONAL,
+	DMA_TO_DEVICE,
+	DMA_FROM_DEVICE,
+};
+
+struct device {
+	int unused;
+};
+
+void *dma_alloc_coherent(struct device *dev, size_t size,
+		dma_addr_t *dma, gfp_t gfp);
+void dma_free_coherent(struct device *dev, size_t size, void *cpu,
+		dma_addr_t dma);
+dma_addr_t dma_map_single(struct device *dev, void *cpu, size_t size,
+		enum dma_data_direction dir);
+void dma_unmap_single(struct device *dev, dma_addr_t dma, size_t size,
+		enum dma_data_direction dir);
+dma_addr_t dma_map_page(struct device *dev, struct page *page,
+		unsigned long offset, size_t size, enum dma_data_direction dir);
+#define dma_unmap_page		dma_unmap_single
+#define dma_mapping_error(dev, dma)	((dma) == 0)
+/* the model accesses host memory, nothing to sync */
+#define dma_sync_single_range_for_cpu(dev, dma, off, size, dir) \
+	((void)(dma))
+#define dma_sync_single_range_for_device(dev, dma, off, size, dir) \
+	((void)(dma))
+
+/* the host memory behind a bus address range, NULL if not mapped */
+void *kshim_dma_ptr(dma_addr_t dma, size_t len);
+
+/* skbuff.h: skb_shared_info lives in the skb rather than behind the
+ * data, the layout the driver sizes its RX buffers for is unchanged
+ */
+#define MAX_SKB_FRAGS	17
+#define NET_SKB_PAD	64
+#define NET_IP_ALIGN	2
+#define SKB_DATA_ALIGN(x)	ALIGN(x, L1_CACHE_BYTES)
+
+#define CHECKSUM_NONE		0
+#define CHECKSUM_PARTIAL	3
+
+typedef struct {
+	struct page *page;
+	u32 page_offset;
+	u32 size;
+} skb_frag_t;
+
+struct skb_shared_info {
+	unsigned char nr_frags;
+	skb_frag_t frags[MAX_SKB_FRAGS];
+};
+
+struct net_device;
+
+struct sk_buff {
+	struct sk_buff *next;
+	struct net_device *dev;
+	unsigned char *head;
+	unsigned char *data;
+	unsigned int len;
+	unsigned int data_len;
+	/* head is part of a page, see build_skb() */
+	bool head_frag;
+	u8 ip_summed;
+	__be16 protocol;
+	struct skb_shared_info shinfo;
+};
+
+struct sk_buff *netdev_alloc_skb_ip_align(struct net_device *ndev,
+		unsigned int len);
+struct sk_buff *build_skb(void *data, unsigned int frag_size);
+/* kfree_skb() counts as a drop, consume_skb() as a normal release */
+void kfree_skb(struct sk_buff *skb);
+void consume_skb(struct sk_buff *skb);
+#define dev_kfree_skb(skb)	consume_skb(skb)
+#define dev_kfree_skb_any(skb)	consume_skb(skb)
+int skb_copy_bits(const struct sk_buff *skb, int offset, void *to, int len);
+
+#define skb_shinfo(skb)		(&(skb)->shinfo)
+#define skb_headlen(skb)	((skb)->len - (skb)->data_len)
+#define skb_frag_size(frag)	((frag)->size)
+#define skb_frag_dma_map(dev, frag, off, size, dir) \
+	dma_map_page(dev, (frag)->page, (frag)->page_offset + (off), size, dir)
+
+static inline unsigned char *skb_put(struct sk_buff *skb, unsigned int len)
+{
+	unsigned char *tail = skb->data + skb->len;
+
+	skb->len += len;
+	return tail;
+}
+
+static inline void skb_reserve(struct sk_buff *skb, int len)
+{
+	skb->data += len;
+}
+
+static inline void skb_copy_to_linear_data(struct sk_buff *skb,
+		const void *from, unsigned int len)
+{
+	memcpy(skb->data, from, len);
+}
+
+static inline int skb_checksum_help(struct sk_buff *skb)
+{
+	skb->ip_summed = CHECKSUM_NONE;
+	return 0;
+}
+
+/* netdevice.h, etherdevice.h */
+#define ETH_ALEN	6
+#define ETH_HLEN	14
+#define ETH_ZLEN	60
+#define ETH_FCS_LEN	4
+
+#define IFF_PROMISC	0x100
+#define IFF_ALLMULTI	0x200
+
+#define NETIF_F_SG	0x1
+#define NETIF_F_HW_CSUM	0x8
+
+typedef enum {
+	NETDEV_TX_OK = 0,
+	NETDEV_TX_BUSY = 0x10,
+} netdev_tx_t;
+
+struct net_device_stats {
+	unsigned long rx_packets, tx_packets, rx_bytes, tx_bytes;
+	unsigned long rx_errors, tx_errors, rx_dropped, tx_dropped;
+	unsigned long multicast, collisions;
+	unsigned long rx_length_errors, rx_over_errors, rx_crc_errors;
+	unsigned long rx_frame_errors, rx_fifo_errors, rx_missed_errors;
+	unsigned long tx_aborted_errors, tx_carrier_errors, tx_fifo_errors;
+	unsigned long tx_heartbeat_errors, tx_window_errors;
+};
+
+struct rtnl_link_stats64 {
+	u64 rx_packets, tx_packets, rx_bytes, tx_bytes;
+	u64 rx_errors, tx_errors, rx_dropped, tx_dropped;
+	u64 multicast, collisions;
+	u64 rx_length_errors, rx_over_errors, rx_crc_errors;
+	u64 rx_frame_errors, rx_fifo_errors, rx_missed_errors;
+	u64 tx_aborted_errors, tx_carrier_errors, tx_fifo_errors;
+	u64 tx_heartbeat_errors, tx_window_errors;
+};
+
+void netdev_stats_to_stats64(struct rtnl_link_stats64 *stats64,
+		const struct net_device_stats *stats);
+
+enum {
+	NAPI_STATE_SCHED,
+	NAPI_STATE_DISABLE,
+};
+
+struct napi_struct {
+	struct napi_struct *next;
+	struct net_device *dev;
+	int (*poll)(struct napi_struct *napi, int budget);
+	int weight;
+	unsigned long state;
+	/* on the poll list of the (only) CPU */
+	bool listed;
+};
+
+/* queue state: stopped by the driver or by BQL */
+enum {
+	__QUEUE_STATE_DRV_XOFF,
+	__QUEUE_STATE_STACK_XOFF,
+};
+
+/* BQL with a fixed limit, the stack stops the queue above it */
+struct netdev_queue {
+	unsigned long state;
+	unsigned int inflight;
+	unsigned int limit;
+	unsigned long wakeups;
+};
+
+struct netdev_hw_addr {
+	u8 addr[ETH_ALEN];
+};
+
+#define KSHIM_MC_MAX	16
+
+struct ethtool_ops;
+struct net_device_ops;
+
+struct net_device {
+	char name[16];
+	unsigned long state;
+	unsigned int flags;
+	unsigned long base_addr;
+	int irq;
+	u8 dev_addr[ETH_ALEN];
+	unsigned long features;
+	unsigned long hw_features;
+	struct net_device_stats stats;
+	const struct net_device_ops *netdev_ops;
+	const struct ethtool_ops *ethtool_ops;
+	struct netdev_queue txq;
+	struct netdev_hw_addr mc[KSHIM_MC_MAX];
+	unsigned int mc_count;
+	/* frames passed up by napi_gro_receive(), oldest first */
+	struct sk_buff *rx_head;
+	struct sk_buff *rx_tail;
+	unsigned int rx_count;
+};
+
+/* __LINK_STATE_START */
+#define KSHIM_LINK_START	0
+
+struct net_device_ops {
+	int (*ndo_open)(struct net_device *ndev);
+	int (*ndo_stop)(struct net_device *ndev);
+	netdev_tx_t (*ndo_start_xmit)(struct sk_buff *skb,
+			struct net_device *ndev);
+	void (*ndo_set_rx_mode)(struct net_device *ndev);
+	struct rtnl_link_stats64 *(*ndo_get_stats64)(struct net_device *ndev,
+			struct rtnl_link_stats64 *stats);
+};
+
+struct net_device *alloc_etherdev(int sizeof_priv);
+void free_netdev(struct net_device *ndev);
+int register_netdev(struct net_device *ndev);
+void unregister_netdev(struct net_device *ndev);
+
+static inline void *netdev_priv(const struct net_device *ndev)
+{
+	return (char *)ndev + ALIGN(sizeof(struct net_device), L1_CACHE_BYTES);
+}
+
+#define SET_NETDEV_DEV(ndev, dev)	((void)(dev))
+#define netif_running(ndev)	test_bit(KSHIM_LINK_START, &(ndev)->state)
+#define netdev_for_each_mc_addr(ha, ndev) \
+	for ((ha) = (ndev)->mc; (ha) < (ndev)->mc + (ndev)->mc_count; (ha)++)
+
+#define netdev_get_tx_queue(ndev, i)	(&(ndev)->txq)
+
+static inline bool netif_xmit_stopped(const struct netdev_queue *txq)
+{
+	return txq->state != 0;
+}
+
+static inline bool netif_queue_stopped(const struct net_device *ndev)
+{
+	return test_bit(__QUEUE_STATE_DRV_XOFF, &ndev->txq.state);
+}
+
+static inline void netif_start_queue(struct net_device *ndev)
+{
+	__clear_bit(__QUEUE_STATE_DRV_XOFF, &ndev->txq.state);
+}
+
+#define netif_stop_queue(ndev)	__set_bit(__QUEUE_STATE_DRV_XOFF, \
+		&(ndev)->txq.state)
+#define netif_tx_disable(ndev)	netif_stop_queue(ndev)
+
+static inline void netif_wake_queue(struct net_device *ndev)
+{
+	if (netif_queue_stopped(ndev))
+		ndev->txq.wakeups++;
+	netif_start_queue(ndev);
+}
+
+void netdev_sent_queue(struct net_device *ndev, unsigned int bytes);
+void netdev_completed_queue(struct net_device *ndev, unsigned int pkts,
+		unsigned int bytes);
+void netdev_reset_queue(struct net_device *ndev);
+
+void netif_napi_add(struct net_device *ndev, struct napi_struct *napi,
+		int (*poll)(struct napi_struct *, int), int weight);
+void napi_enable(struct napi_struct *napi);
+void napi_disable(struct napi_struct *napi);
+bool napi_schedule_prep(struct napi_struct *napi);
+void __napi_schedule(struct napi_struct *napi);
+void napi_complete(struct napi_struct *napi);
+int napi_gro_receive(struct napi_struct *napi, struct sk_buff *skb);
+
+static inline void napi_schedule(struct napi_struct *napi)
+{
+	if (napi_schedule_prep(napi))
+		__napi_schedule(napi);
+}
+
+/* the header is left in place, so the tests see the whole frame */
+static inline __be16 eth_type_trans(struct sk_buff *skb,
+		struct net_device *ndev)
+{
+	skb->dev = ndev;
+	return (__be16)(skb->data[12] | skb->data[13] << 8);
+}
+
+static inline bool is_valid_ether_addr(const u8 *addr)
+{
+	static const u8 zero[ETH_ALEN];
+
+	return !(addr[0] & 1) && memcmp(addr, zero, ETH_ALEN);
+}
+
+static inline void random_ether_addr(u8 *addr)
+{
+	static const u8 local[ETH_ALEN] = { 0x02, 0, 0, 0, 0, 0x01 };
+
+	memcpy(addr, local, ETH_ALEN);
+}
+
+/* crc32.h */
+u32 ether_crc_le(int len, const unsigned char *p);
+
+/* ethtool.h */
+#define ETH_GSTRING_LEN	32
+#define ETH_SS_STATS	1
+
+struct ethtool_ringparam {
+	u32 cmd;
+	u32 rx_max_pending, rx_mini_max_pending, rx_jumbo_max_pending;
+	u32 tx_max_pending;
+	u32 rx_pending, rx_mini_pending, rx_jumbo_pending, tx_pending;
+};
+
+struct ethtool_coalesce {
+	u32 cmd;
+	u32 rx_coalesce_usecs, rx_max_coalesced_frames;
+	u32 rx_coalesce_usecs_irq, rx_max_coalesced_frames_irq;
+	u32 tx_coalesce_usecs, tx_max_coalesced_frames;
+	u32 tx_coalesce_usecs_irq, tx_max_coalesced_frames_irq;
+	u32 stats_block_coalesce_usecs;
+	u32 use_adaptive_rx_coalesce, use_adaptive_tx_coalesce;
+	u32 pkt_rate_low;
+	u32 rx_coalesce_usecs_low, rx_max_coalesced_frames_low;
+	u32 tx_coalesce_usecs_low, tx_max_coalesced_frames_low;
+	u32 pkt_rate_high;
+	u32 rx_coalesce_usecs_high, rx_max_coalesced_frames_high;
+	u32 tx_coalesce_usecs_high, tx_max_coalesced_frames_high;
+	u32 rate_sample_interval;
+};
+
+struct ethtool_stats {
+	u32 cmd;
+	u32 n_stats;
+};
+
+struct ethtool_ops {
+	u32 (*get_link)(struct net_device *ndev);
+	int (*get_coalesce)(struct net_device *ndev,
+			struct ethtool_coalesce *ec);
+	int (*set_coalesce)(struct net_device *ndev,
+			struct ethtool_coalesce *ec);
+	void (*get_ringparam)(struct net_device *ndev,
+			struct ethtool_ringparam *ering);
+	int (*set_ringparam)(struct net_device *ndev,
+			struct ethtool_ringparam *ering);
+	int (*get_sset_count)(struct net_device *ndev, int sset);
+	void (*get_strings)(struct net_device *ndev, u32 sset, u8 *data);
+	void (*get_ethtool_stats)(struct net_device *ndev,
+			struct ethtool_stats *stats, u64 *data);
+};
+
+static inline u32 ethtool_op_get_link(struct net_device *ndev)
+{
+	return 1;
+}
+
+/* interrupt.h: handlers run from kshim_run() while the line is active */
+typedef enum {
+	IRQ_NONE,
+	IRQ_HANDLED,
+} irqreturn_t;
+
+#define IRQF_SHARED	0x80
+
+int request_irq(unsigned int irq, irqreturn_t (*handler)(int, void *),
+		unsigned long flags, const char *name, void *dev_id);
+void free_irq(unsigned int irq, void *dev_id);
+
+/* timer.h, hrtimer.h: both fire from kshim_advance() */
+struct timer_list {
+	struct timer_list *next;
+	unsigned long expires;
+	void (*function)(unsigned long data);
+	unsigned long data;
+	bool pending;
+};
+
+void setup_timer(struct timer_list *timer, void (*fn)(unsigned long),
+		unsigned long data);
+int mod_timer(struct timer_list *timer, unsigned long expires);
+int del_timer_sync(struct timer_list *timer);
+#define timer_pending(timer)	((timer)->pending)
+
+enum hrtimer_restart {
+	HRTIMER_NORESTART,
+	HRTIMER_RESTART,
+};
+
+enum hrtimer_mode {
+	HRTIMER_MODE_REL,
+};
+
+#define CLOCK_MONOTONIC	1
+
+struct hrtimer {
+	struct hrtimer *next;
+	enum hrtimer_restart (*function)(struct hrtimer *timer);
+	ktime_t expires;
+	bool active;
+};
+
+void hrtimer_init(struct hrtimer *timer, int clock, enum hrtimer_mode mode);
+int hrtimer_start(struct hrtimer *timer, ktime_t delay,
+		enum hrtimer_mode mode);
+int hrtimer_cancel(struct hrtimer *timer);
+
+/* pci.h: BAR 0 (I/O) and BAR 1 (memory) both decode the register window
+ * of the device model behind kshim_pci_ops
+ */
+#define PCI_VENDOR_ID_AMD	0x1022
+#define PCI_DEVICE_ID_AMD_LANCE	0x2000
+
+#define IORESOURCE_IO	0x100
+#define IORESOURCE_MEM	0x200
+
+#define KSHIM_IO_WINDOW	0x20
+
+struct pci_device_id {
+	u32 vendor, device;
+};
+
+#define PCI_DEVICE(v, d)	.vendor = (v), .device = (d)
+#define DEFINE_PCI_DEVICE_TABLE(name)	const struct pci_device_id name[]
+
+struct kshim_pci_ops {
+	u32 (*read)(void *opaque, unsigned int off, unsigned int size);
+	void (*write)(void *opaque, unsigned int off, unsigned int size,
+			u32 val);
+	/* state of the interrupt line */
+	bool (*irq)(void *opaque);
+	/* the CPU spent 'usecs' in udelay() */
+	void (*delay)(void *opaque, unsigned long usecs);
+};
+
+struct resource {
+	unsigned long flags;
+	unsigned long len;
+};
+
+struct pci_dev {
+	struct pci_dev *next;
+	struct device dev;
+	unsigned int irq;
+	char name[16];
+	struct resource resource[2];
+	void *drvdata;
+	const struct kshim_pci_ops *ops;
+	void *opaque;
+	/* bus addresses of the BARs, only compared against */
+	unsigned char window[2][KSHIM_IO_WINDOW];
+	/* pci_iomap() of BAR 1 fails */
+	bool fail_mmio;
+};
+
+struct pci_driver {
+	const char *name;
+	const struct pci_device_id *id_table;
+	int (*probe)(struct pci_dev *pdev, const struct pci_device_id *id);
+	void (*remove)(struct pci_dev *pdev);
+};
+
+#define pci_enable_device(pdev)		0
+#define pci_disable_device(pdev)	((void)(pdev))
+#define pci_set_master(pdev)		((void)(pdev))
+#define pci_request_regions(pdev, name)	0
+#define pci_release_regions(pdev)	((void)(pdev))
+#define pci_resource_flags(pdev, bar)	((pdev)->resource[bar].flags)
+#define pci_resource_len(pdev, bar)	((pdev)->resource[bar].len)
+#define pci_set_drvdata(pdev, data)	((pdev)->drvdata = (data))
+#define pci_get_drvdata(pdev)		((pdev)->drvdata)
+#define pci_name(pdev)			((pdev)->name)
+#define pci_iounmap(pdev, addr)		((void)(addr))
+
+void __iomem *pci_iomap(struct pci_dev *pdev, int bar, unsigned long max);
+int pci_register_driver(struct pci_driver *drv);
+void pci_unregister_driver(struct pci_driver *drv);
+
+/* io.h */
+u8 ioread8(void __iomem *addr);
+u16 ioread16(void __iomem *addr);
+u32 ioread32(void __iomem *addr);
+void iowrite16(u16 val, void __iomem *addr);
+void iowrite32(u32 val, void __iomem *addr);
+
+/* debugfs.h, seq_file.h, fs.h: seq_printf() writes to a stdio stream */
+struct dentry;
+struct inode {
+	void *i_private;
+};
+
+struct file {
+	void *private_data;
+};
+
+struct seq_file {
+	FILE *f;
+	void *private;
+};
+
+struct file_operations {
+	void *owner;
+	int (*open)(struct inode *inode, struct file *file);
+	ssize_t (*read)(struct file *file, char __user *buf, size_t len,
+			loff_t *ppos);
+	ssize_t (*write)(struct file *file, const char __user *buf,
+			size_t len, loff_t *ppos);
+	loff_t (*llseek)(struct file *file, loff_t off, int whence);
+	int (*release)(struct inode *inode, struct file *file);
+};
+
+struct dentry *debugfs_create_dir(const char *name, struct dentry *parent);
+struct dentry *debugfs_create_file(const char *name, unsigned int mode,
+		struct dentry *parent, void *data,
+		const struct file_operations *fops);
+#define debugfs_remove_recursive(d)	((void)(d))
+
+int seq_printf(struct seq_file *m, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+int single_open(struct file *file, int (*show)(struct seq_file *, void *),
+		void *data);
+int single_release(struct inode *inode, struct file *file);
+ssize_t seq_read(struct file *file, char __user *buf, size_t len,
+		loff_t *ppos);
+loff_t seq_lseek(struct file *file, loff_t off, int whence);
+int kstrtouint_from_user(const char __user *s, size_t count,
+		unsigned int base, unsigned int *res);
+
+/* tracepoint.h: the events compile to nothing */
+#define TP_PROTO(args...)	args
+#define TP_ARGS(args...)	args
+#define TRACE_EVENT(name, proto, args, tstruct, assign, print) \
+	static inline void trace_##name(proto) {}
+
+/*
+ * Harness side
+ */
+
+/* Live objects, all zero once a device is removed again. Failure
+ * injection counts down the calls until the one that fails.
+ */
+struct kshim_state {
+	long pages;
+	long skbs;
+	long allocs;
+	long dma_maps;
+	long timers;
+	u64 skbs_dropped;
+	u64 skbs_consumed;
+	unsigned int messages[3];
+	unsigned int bugs;
+	unsigned int rtnl;
+	/* 1 fails the next call, 2 the one after it and so on */
+	unsigned int fail_alloc_page;
+	unsigned int fail_dma_map;
+	unsigned int fail_kmalloc;
+	unsigned int fail_coherent;
+	/* runs in napi_complete() before the poll is completed */
+	void (*napi_complete_hook)(struct napi_struct *napi);
+};
+
+extern struct kshim_state kshim;
+
+struct pci_dev *kshim_pci_create(const struct kshim_pci_ops *ops,
+		void *opaque);
+void kshim_pci_destroy(struct pci_dev *pdev);
+int kshim_pci_probe(struct pci_dev *pdev);
+void kshim_pci_remove(struct pci_dev *pdev);
+
+int kshim_dev_open(struct net_device *ndev);
+void kshim_dev_close(struct net_device *ndev);
+netdev_tx_t kshim_xmit(struct net_device *ndev, struct sk_buff *skb);
+struct sk_buff *kshim_rx_pop(struct net_device *ndev);
+void kshim_rx_purge(struct net_device *ndev);
+struct sk_buff *kshim_alloc_skb(unsigned int len);
+
+/* runs the handler if the interrupt line of 'pdev' is active */
+bool kshim_irq(struct pci_dev *pdev);
+/* handles interrupts and NAPI polls until nothing is pending */
+void kshim_run(void);
+/* advances the virtual clock, firing timers on the way */
+void kshim_advance(s64 ns);
+
+#endif /* _KSHIM_H */
@@ -0,0 +1,595 @@
+/* pcnet_model.c: register level model of the PCnet-PCI II (Am79C970A) */
+
+#include "pcnet.h"
+#include "pcnet_model.h"
+
+/* what the driver doesn't need from the datasheet */
+enum {
+	MODEL_CSR3_BABLM = 0x4000,
+	MODEL_CSR3_MISSM = 0x1000,
+	MODEL_CSR3_MERRM = 0x0800,
+	MODEL_CSR3_IDONM = 0x0100,
+	MODEL_CSR4_DEFAULT = 0x0115,
+	/* physical address, CSR12 holds bytes 0 and 1 */
+	MODEL_CSR12 = 12,
+	/* Am79C970A: part ID 0x2621, version 1 */
+	MODEL_CSR88 = 0x1003,
+	MODEL_CSR89 = 0x0262,
+	MODEL_SWSTYLE_MASK = 0x00ff,
+	/* SWSTYLE 2 init block and descriptors */
+	MODEL_IB_LEN = 28,
+	MODEL_DESC_LEN = 16,
+	MODEL_RING_LOG2_MAX = 9,
+};
+
+struct model_desc {
+	__le32 addr;
+	__le16 size;
+	__le16 status;
+	__le32 flags;
+	__le32 reserved;
+};
+
+static void model_violation(struct pcnet_model *m, const char *what)
+{
+	m->st.violations++;
+	fprintf(stderr, "pcnet model: %s\n", what);
+}
+
+static void model_dma_fault(struct pcnet_model *m)
+{
+	m->st.dma_faults++;
+	m->csr[CSR0] |= CSR0_MERR;
+}
+
+/* the CRC register after the destination address, not inverted */
+static u32 model_crc(const u8 *p, unsigned int len)
+{
+	u32 crc = ~0U;
+	unsigned int i;
+
+	while (len--) {
+		crc ^= *p++;
+		for (i = 0; i < 8; i++)
+			crc = crc & 1 ? (crc >> 1) ^ 0xedb88320 : crc >> 1;
+	}
+	return crc;
+}
+
+/* two's complement 12-bit byte count, the upper 4 bits must be ones */
+static unsigned int model_bcnt(struct pcnet_model *m, u16 size)
+{
+	if ((size & DESC_BCNT_ONES) != DESC_BCNT_ONES)
+		model_violation(m, "BCNT without the ONES bits");
+	return (0x1000 - (size & 0x0fff)) & 0x0fff;
+}
+
+static struct model_desc *model_desc(struct pcnet_model *m, u32 base,
+		unsigned int len, unsigned int i)
+{
+	struct model_desc *d;
+
+	d = kshim_dma_ptr(base + (i & (len - 1)) * MODEL_DESC_LEN,
+			MODEL_DESC_LEN);
+	if (!d)
+		model_dma_fault(m);
+	return d;
+}
+
+void *pcnet_model_rx_desc(struct pcnet_model *m, unsigned int i)
+{
+	return model_desc(m, m->rx_base, m->rx_len, i);
+}
+
+void *pcnet_model_tx_desc(struct pcnet_model *m, unsigned int i)
+{
+	return model_desc(m, m->tx_base, m->tx_len, i);
+}
+
+bool pcnet_model_running(const struct pcnet_model *m)
+{
+	return m->csr[CSR0] & CSR0_TXON;
+}
+
+/* CSR0 with the ERR and INTR summary bits */
+static u16 model_csr0(const struct pcnet_model *m)
+{
+	u16 csr0 = m->csr[CSR0] & ~(CSR0_ERR | CSR0_INTR);
+	u16 csr3 = m->csr[CSR3];
+
+	if (csr0 & (CSR0_BABL | CSR0_CERR | CSR0_MISS | CSR0_MERR))
+		csr0 |= CSR0_ERR;
+	if (((csr0 & CSR0_BABL) && !(csr3 & MODEL_CSR3_BABLM)) ||
+	    ((csr0 & CSR0_MISS) && !(csr3 & MODEL_CSR3_MISSM)) ||
+	    ((csr0 & CSR0_MERR) && !(csr3 & MODEL_CSR3_MERRM)) ||
+	    ((csr0 & CSR0_RINT) && !(csr3 & CSR3_RINTM)) ||
+	    ((csr0 & CSR0_TINT) && !(csr3 & CSR3_TINTM)) ||
+	    ((csr0 & CSR0_IDON) && !(csr3 & MODEL_CSR3_IDONM)))
+		csr0 |= CSR0_INTR;
+	return csr0;
+}
+
+static void model_emit(struct pcnet_model *m, const u8 *data,
+		unsigned int len)
+{
+	struct pcnet_model_frame *f;
+
+	if (m->tx_frame) {
+		m->tx_frame(m, data, len);
+		return;
+	}
+	f = &m->tx_log[m->st.tx_frames % PCNET_MODEL_TX_LOG];
+	memcpy(f->data, data, len);
+	f->len = len;
+}
+
+const struct pcnet_model_frame *pcnet_model_tx_last(struct pcnet_model *m,
+		unsigned int n)
+{
+	if (n >= m->st.tx_frames || n >= PCNET_MODEL_TX_LOG)
+		return NULL;
+	return &m->tx_log[(m->st.tx_frames - 1 - n) % PCNET_MODEL_TX_LOG];
+}
+
+/* Transmits the frame at tx_cur if the whole chain from STP to ENP is
+ * owned by the controller, then hands the descriptors back.
+ */
+static bool model_tx_one(struct pcnet_model *m)
+{
+	u8 frame[PCNET_MODEL_FRAME_MAX];
+	unsigned int n, len = 0, blen;
+	struct model_desc *d;
+	u16 status;
+	void *src;
+
+	for (n = 0; ; n++) {
+		if (n == m->tx_len) {
+			model_violation(m, "TX chain without ENP");
+			return false;
+		}
+		d = model_desc(m, m->tx_base, m->tx_len, m->tx_cur + n);
+		if (!d)
+			return false;
+		status = le16_to_cpu(d->status);
+		/* the rest of the chain isn't there yet */
+		if (!(status & DESC_OWN))
+			return false;
+		if (!n != !!(status & DESC_STP)) {
+			model_violation(m, "STP only allowed on the first "
+					"descriptor of a frame");
+			return false;
+		}
+		blen = model_bcnt(m, le16_to_cpu(d->size));
+		if (len + blen > sizeof(frame)) {
+			model_violation(m, "TX frame too long");
+			return false;
+		}
+		src = kshim_dma_ptr(le32_to_cpu(d->addr), blen);
+		if (!src) {
+			model_dma_fault(m);
+			return false;
+		}
+		memcpy(frame + len, src, blen);
+		len += blen;
+		if (status & DESC_ENP)
+			break;
+	}
+
+	if ((m->csr[CSR4] & CSR4_APAD_XMT) && len < ETH_ZLEN) {
+		memset(frame + len, 0, ETH_ZLEN - len);
+		len = ETH_ZLEN;
+	}
+	if (!m->tx_error)
+		model_emit(m, frame, len);
+	m->st.tx_frames++;
+
+	/* descriptors are handed back in order, ENP carries the status */
+	for (blen = 0; blen <= n; blen++) {
+		d = model_desc(m, m->tx_base, m->tx_len, m->tx_cur + blen);
+		status = le16_to_cpu(d->status) & ~DESC_OWN;
+		if (blen == n) {
+			d->flags = cpu_to_le32(m->tx_error ?
+					m->tx_error_flags : 0);
+			if (m->tx_error)
+				status |= DESC_ERR;
+		}
+		wmb();
+		d->status = cpu_to_le16(status);
+	}
+	m->tx_error = 0;
+	m->tx_cur += n + 1;
+	m->csr[CSR0] |= CSR0_TINT;
+	return true;
+}
+
+static unsigned int model_tx(struct pcnet_model *m, unsigned int max)
+{
+	unsigned int n = 0;
+
+	while (n < max && (m->csr[CSR0] & CSR0_TXON) && !m->suspended &&
+			model_tx_one(m))
+		n++;
+	return n;
+}
+
+/* TDMD, the start of the transmitter and the end of a suspend */
+static void model_tx_poll(struct pcnet_model *m)
+{
+	m->st.tx_polls++;
+	if (!m->tx_hold)
+		model_tx(m, ~0U);
+}
+
+unsigned int pcnet_model_tx_run(struct pcnet_model *m, unsigned int max)
+{
+	return model_tx(m, max);
+}
+
+static bool model_rx_accept(const struct pcnet_model *m, const u8 *dst)
+{
+	static const u8 bcast[ETH_ALEN] = {
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+	};
+	unsigned int i;
+	u32 crc;
+
+	if (m->csr[CSR15] & CSR15_PROM)
+		return true;
+	if (!memcmp(dst, bcast, ETH_ALEN))
+		return true;
+	if (dst[0] & 1) {
+		crc = model_crc(dst, ETH_ALEN) >> 26;
+		return m->csr[CSR8 + crc / 16] & (1 << (crc % 16));
+	}
+	for (i = 0; i < ETH_ALEN; i += 2)
+		if ((dst[i] | dst[i + 1] << 8) != m->csr[MODEL_CSR12 + i / 2])
+			return false;
+	return true;
+}
+
+enum pcnet_model_rx pcnet_model_rx(struct pcnet_model *m, const u8 *data,
+		unsigned int len)
+{
+	unsigned int blen, flen = len + ETH_FCS_LEN;
+	struct model_desc *d;
+	u16 status;
+	u8 *dst;
+
+	if (!(m->csr[CSR0] & CSR0_RXON) || m->suspended) {
+		m->st.rx_off++;
+		return PCNET_MODEL_RX_OFF;
+	}
+	if (!model_rx_accept(m, data)) {
+		m->st.rx_filtered++;
+		return PCNET_MODEL_RX_FILTERED;
+	}
+	d = model_desc(m, m->rx_base, m->rx_len, m->rx_cur);
+	if (!d)
+		return PCNET_MODEL_RX_OFF;
+	if (!(le16_to_cpu(d->status) & DESC_OWN)) {
+		m->csr[CSR0] |= CSR0_MISS;
+		m->st.rx_missed++;
+		return PCNET_MODEL_RX_MISSED;
+	}
+
+	blen = model_bcnt(m, le16_to_cpu(d->size));
+	dst = kshim_dma_ptr(le32_to_cpu(d->addr), blen);
+	if (!dst) {
+		model_dma_fault(m);
+		return PCNET_MODEL_RX_OFF;
+	}
+	status = DESC_STP | DESC_ENP;
+	if (flen > blen) {
+		/* the model doesn't chain RX buffers */
+		memcpy(dst, data, blen);
+		status |= DESC_ERR | DESC_RX_BUFF;
+	} else {
+		/* the driver strips the FCS unseen, it is left as zeros */
+		memcpy(dst, data, len);
+		memset(dst + len, 0, ETH_FCS_LEN);
+	}
+	if (m->rx_error) {
+		status |= DESC_ERR | m->rx_error;
+		m->rx_error = 0;
+	}
+	d->flags = cpu_to_le32(flen & RMD2_MCNT_MASK);
+	wmb();
+	d->status = cpu_to_le16(status);
+	m->rx_cur++;
+	m->csr[CSR0] |= CSR0_RINT;
+	m->st.rx_frames++;
+	return PCNET_MODEL_RX_OK;
+}
+
+static void model_stop(struct pcnet_model *m)
+{
+	m->csr[CSR0] = CSR0_STOP;
+	m->inited = false;
+	m->suspended = false;
+	m->spnd_req = false;
+}
+
+static void model_reset(struct pcnet_model *m)
+{
+	m->st.resets++;
+	if (m->reset_fail && !--m->reset_fail) {
+		m->csr[CSR0] = 0;
+		return;
+	}
+	model_stop(m);
+	m->rap = 0;
+	m->csr[CSR3] = 0;
+	m->csr[CSR4] = MODEL_CSR4_DEFAULT;
+	m->csr[CSR5] = 0;
+	m->csr[CSR15] = 0;
+	m->bcr[BCR20] = 0;
+}
+
+static u16 model_ib16(const u8 *ib, unsigned int off)
+{
+	return ib[off] | ib[off + 1] << 8;
+}
+
+static u32 model_ib32(const u8 *ib, unsigned int off)
+{
+	return model_ib16(ib, off) | (u32)model_ib16(ib, off + 2) << 16;
+}
+
+/* INIT: reads the SWSTYLE 2 init block at CSR2:CSR1 */
+static void model_init_block(struct pcnet_model *m)
+{
+	u32 addr = m->csr[CSR1] | (u32)m->csr[CSR2] << 16;
+	unsigned int tlen, rlen, i;
+	const u8 *ib;
+
+	m->st.inits++;
+	if (!(m->csr[CSR0] & CSR0_STOP))
+		model_violation(m, "INIT without STOP");
+	if ((m->bcr[BCR20] & MODEL_SWSTYLE_MASK) != BCR20_SWSTYLE_PCNET_PCI)
+		model_violation(m, "INIT with a software style other than 2");
+	if (m->init_fail && !--m->init_fail)
+		return;
+	ib = kshim_dma_ptr(addr, MODEL_IB_LEN);
+	if (!ib) {
+		model_dma_fault(m);
+		return;
+	}
+
+	tlen = model_ib16(ib, 2) >> 12 & 0xf;
+	rlen = model_ib16(ib, 2) >> 4 & 0xf;
+	if (tlen > MODEL_RING_LOG2_MAX || rlen > MODEL_RING_LOG2_MAX)
+		model_violation(m, "ring length above 512");
+	m->csr[CSR15] = model_ib16(ib, 0);
+	for (i = 0; i < 3; i++)
+		m->csr[MODEL_CSR12 + i] = model_ib16(ib, 4 + 2 * i);
+	for (i = 0; i < 4; i++)
+		m->csr[CSR8 + i] = model_ib16(ib, 12 + 2 * i);
+	m->rx_base = model_ib32(ib, 20);
+	m->tx_base = model_ib32(ib, 24);
+	if ((m->rx_base | m->tx_base) % MODEL_DESC_LEN)
+		model_violation(m, "descriptor ring not 16 byte aligned");
+	m->rx_len = 1 << rlen;
+	m->tx_len = 1 << tlen;
+	m->rx_cur = 0;
+	m->tx_cur = 0;
+	m->inited = true;
+	m->csr[CSR0] = (m->csr[CSR0] & ~CSR0_STOP) | CSR0_INIT | CSR0_IDON;
+}
+
+static void model_start(struct pcnet_model *m)
+{
+	if (!m->inited) {
+		model_violation(m, "STRT without INIT");
+		return;
+	}
+	m->csr[CSR0] = (m->csr[CSR0] & ~CSR0_STOP) | CSR0_STRT | CSR0_TXON |
+		CSR0_RXON;
+	model_tx_poll(m);
+}
+
+static void model_write_csr0(struct pcnet_model *m, u16 val)
+{
+	if (val & CSR0_STOP) {
+		model_stop(m);
+		return;
+	}
+	m->csr[CSR0] &= ~(val & CSR0_INT_ACK);
+	m->csr[CSR0] = (m->csr[CSR0] & ~CSR0_IENA) | (val & CSR0_IENA);
+	if (val & CSR0_INIT)
+		model_init_block(m);
+	if (val & CSR0_STRT)
+		model_start(m);
+	if ((val & CSR0_TDMD) && (m->csr[CSR0] & CSR0_TXON))
+		model_tx_poll(m);
+}
+
+static void model_write_csr5(struct pcnet_model *m, u16 val)
+{
+	m->csr[CSR5] = val & ~CSR5_SPND;
+	if (!(val & CSR5_SPND)) {
+		if (m->suspended || m->spnd_req) {
+			m->suspended = false;
+			m->spnd_req = false;
+			model_tx_poll(m);
+		}
+		return;
+	}
+	if (m->spnd_req || m->suspended)
+		return;
+	m->spnd_req = true;
+	m->spnd_left_us = m->spnd_delay_us;
+	if (!pcnet_model_running(m) || !m->spnd_left_us)
+		m->suspended = true;
+}
+
+static u16 model_read_csr(struct pcnet_model *m, u32 reg)
+{
+	switch (reg) {
+	case CSR0:
+		return model_csr0(m);
+	case CSR5:
+		return m->csr[CSR5] | (m->suspended ? CSR5_SPND : 0);
+	case CSR88:
+		return MODEL_CSR88;
+	case CSR89:
+		return MODEL_CSR89;
+	default:
+		return m->csr[reg];
+	}
+}
+
+static void model_write_csr(struct pcnet_model *m, u32 reg, u16 val)
+{
+	switch (reg) {
+	case CSR0:
+		model_write_csr0(m, val);
+		break;
+	case CSR5:
+		model_write_csr5(m, val);
+		break;
+	case CSR8:
+	case CSR9:
+	case CSR10:
+	case CSR11:
+	case CSR15:
+		if (pcnet_model_running(m) && !m->suspended)
+			model_violation(m, "filter written while running");
+		m->csr[reg] = val;
+		break;
+	case CSR88:
+	case CSR89:
+		break;
+	default:
+		m->csr[reg] = val;
+		break;
+	}
+}
+
+static u16 model_read_bcr(struct pcnet_model *m, u32 reg)
+{
+	if (reg >= ARRAY_SIZE(m->bcr)) {
+		model_violation(m, "no such BCR");
+		return 0;
+	}
+	if (reg == BCR18)
+		return (m->bcr[BCR18] & ~BCR18_DWIO) |
+			(m->dwio ? BCR18_DWIO : 0);
+	return m->bcr[reg];
+}
+
+static void model_write_bcr(struct pcnet_model *m, u32 reg, u16 val)
+{
+	if (reg >= ARRAY_SIZE(m->bcr)) {
+		model_violation(m, "no such BCR");
+		return;
+	}
+	m->bcr[reg] = val;
+}
+
+/* Word mode: RDP 0x10, RAP 0x12, RESET 0x14, BDP 0x16, dword mode: RDP
+ * 0x10, RAP 0x14, RESET 0x18, BDP 0x1c. Accesses of the other width are
+ * not decoded, they read as 0 and writes are ignored.
+ */
+static u32 model_read(void *opaque, unsigned int off, unsigned int size)
+{
+	struct pcnet_model *m = opaque;
+	unsigned int port = off;
+	u32 val = 0;
+
+	if (off < PCNET_RDP) {
+		while (size--)
+			val |= m->aprom[off + size] << (8 * size);
+		return val;
+	}
+	if (size != (m->dwio ? 4 : 2))
+		return 0;
+	/* dword ports as word ports */
+	if (m->dwio)
+		port = PCNET_RDP16 + (off - PCNET_RDP) / 2;
+	m->st.reg_reads++;
+
+	switch (port) {
+	case PCNET_RDP16:
+		return model_read_csr(m, m->rap);
+	case PCNET_RAP16:
+		return m->rap;
+	case PCNET_RESET16:
+		model_reset(m);
+		return 0;
+	case PCNET_BDP16:
+		return model_read_bcr(m, m->rap);
+	}
+	return ~0U;
+}
+
+static void model_write(void *opaque, unsigned int off, unsigned int size,
+		u32 val)
+{
+	struct pcnet_model *m = opaque;
+	unsigned int port = off;
+
+	if (off < PCNET_RDP) {
+		model_violation(m, "write to the address PROM");
+		return;
+	}
+	/* a dword write to RDP switches to dword I/O */
+	if (!m->dwio && size == 4 && off == PCNET_RDP && !m->no_dwio)
+		m->dwio = true;
+	if (size != (m->dwio ? 4 : 2))
+		return;
+	if (val >> 16)
+		model_violation(m, "upper 16 bits written as non-zero");
+	if (m->dwio)
+		port = PCNET_RDP16 + (off - PCNET_RDP) / 2;
+	m->st.reg_writes++;
+
+	switch (port) {
+	case PCNET_RDP16:
+		model_write_csr(m, m->rap, val);
+		break;
+	case PCNET_RAP16:
+		if ((val & 0xffff) >= ARRAY_SIZE(m->csr))
+			model_violation(m, "RAP out of range");
+		m->rap = val & (ARRAY_SIZE(m->csr) - 1);
+		break;
+	case PCNET_BDP16:
+		model_write_bcr(m, m->rap, val);
+		break;
+	}
+}
+
+static bool model_irq(void *opaque)
+{
+	struct pcnet_model *m = opaque;
+
+	return (m->csr[CSR0] & CSR0_IENA) && (model_csr0(m) & CSR0_INTR);
+}
+
+static void model_delay(void *opaque, unsigned long usecs)
+{
+	struct pcnet_model *m = opaque;
+
+	if (m->spnd_req && !m->suspended) {
+		m->spnd_left_us -= usecs;
+		if (m->spnd_left_us <= 0)
+			m->suspended = true;
+	}
+}
+
+const struct kshim_pci_ops pcnet_model_pci_ops = {
+	.read = model_read,
+	.write = model_write,
+	.irq = model_irq,
+	.delay = model_delay,
+};
+
+void pcnet_model_init(struct pcnet_model *m, const u8 *mac)
+{
+	memset(m, 0, sizeof(*m));
+	memcpy(m->aprom, mac, ETH_ALEN);
+	/* the signature in bytes 14 and 15 */
+	m->aprom[14] = 'W';
+	m->aprom[15] = 'W';
+	model_reset(m);
+	m->st.resets = 0;
+}
@@ -0,0 +1,108 @@
+/* pcnet_model.h: register level model of the PCnet-PCI II (Am79C970A) */
+/*
+ * The model decodes RAP/RDP/BDP and the reset port in word and dword
+ * I/O mode, keeps the CSR0 state machine (INIT, STRT, STOP, TDMD, the
+ * write-one-to-clear status bits and INTR/IENA), reads the SWSTYLE 2
+ * init block and moves frames through the descriptor rings by DMA.
+ * Frames are transmitted at once on TDMD unless TX is held, received
+ * frames go through the physical, broadcast and logical address
+ * filters.
+ *
+ * Anything the driver does that the datasheet forbids is counted in
+ * 'violations' rather than emulated.
+ */
+
+#ifndef _PCNET_MODEL_H
+#define _PCNET_MODEL_H
+
+#include "kshim.h"
+
+#define PCNET_MODEL_FRAME_MAX	2048
+#define PCNET_MODEL_TX_LOG	64
+
+struct pcnet_model_frame {
+	unsigned int len;
+	u8 data[PCNET_MODEL_FRAME_MAX];
+};
+
+struct pcnet_model {
+	u8 aprom[16];
+	/* the controller stays in word I/O mode */
+	bool no_dwio;
+	bool dwio;
+	u32 rap;
+	u16 csr[128];
+	u16 bcr[32];
+
+	/* loaded by INIT */
+	bool inited;
+	u32 rx_base;
+	u32 tx_base;
+	unsigned int rx_len;
+	unsigned int tx_len;
+	unsigned int rx_cur;
+	unsigned int tx_cur;
+
+	bool suspended;
+	bool spnd_req;
+	/* time from setting SPND until the controller is suspended */
+	unsigned long spnd_delay_us;
+	long spnd_left_us;
+
+	/* frames stay owned by the controller until pcnet_model_tx_run() */
+	bool tx_hold;
+	/* count down per INIT/reset, the one reaching zero doesn't complete */
+	unsigned int init_fail;
+	unsigned int reset_fail;
+	/* status and TMD2/RMD2 error bits of the next frame */
+	u16 rx_error;
+	u16 tx_error;
+	u32 tx_error_flags;
+
+	/* transmitted frames go here, or into the log */
+	void (*tx_frame)(struct pcnet_model *m, const u8 *data,
+			unsigned int len);
+	void *priv;
+	struct pcnet_model_frame tx_log[PCNET_MODEL_TX_LOG];
+
+	struct {
+		u64 resets;
+		u64 inits;
+		u64 tx_frames;
+		u64 tx_polls;
+		u64 rx_frames;
+		u64 rx_missed;
+		u64 rx_filtered;
+		u64 rx_off;
+		u64 reg_reads;
+		u64 reg_writes;
+		u64 violations;
+		u64 dma_faults;
+	} st;
+};
+
+enum pcnet_model_rx {
+	PCNET_MODEL_RX_OK,
+	PCNET_MODEL_RX_FILTERED,
+	PCNET_MODEL_RX_MISSED,
+	PCNET_MODEL_RX_OFF,
+};
+
+extern const struct kshim_pci_ops pcnet_model_pci_ops;
+
+/* powered up, in word I/O mode, with 'mac' in the address PROM */
+void pcnet_model_init(struct pcnet_model *m, const u8 *mac);
+/* a frame arriving from the wire, without FCS */
+enum pcnet_model_rx pcnet_model_rx(struct pcnet_model *m, const u8 *data,
+		unsigned int len);
+/* transmits up to 'max' frames even with TX held, returns the count */
+unsigned int pcnet_model_tx_run(struct pcnet_model *m, unsigned int max);
+/* the frame logged 'n' frames before the last one */
+const struct pcnet_model_frame *pcnet_model_tx_last(struct pcnet_model *m,
+		unsigned int n);
+/* the CPU view of the descriptor 'i' of a ring */
+void *pcnet_model_rx_desc(struct pcnet_model *m, unsigned int i);
+void *pcnet_model_tx_desc(struct pcnet_model *m, unsigned int i);
+bool pcnet_model_running(const struct pcnet_model *m);
+
+#endif /* _PCNET_MODEL_H */
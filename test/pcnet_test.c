@@ -0,0 +1,954 @@
+/* pcnet_test.c: the driver's datapath against the device model */
+/*
+ * pcnet.c is included, so that its static functions and pcnet_private
+ * are visible here. Every test probes a fresh controller and checks on
+ * the way out that all pages, skbs, DMA mappings and timers have been
+ * released and that the model has seen nothing the datasheet forbids.
+ *
+ *	./pcnet_test		runs the tests, TAP output
+ *	./pcnet_test --bench	cost of the TX and RX hot paths
+ */
+
+#include "pcnet.c"
+#include "pcnet_model.h"
+
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+struct fixture {
+	struct pcnet_model m;
+	struct pci_dev *pdev;
+	struct net_device *ndev;
+	struct pcnet_private *pp;
+	/* kshim counters before the test */
+	struct kshim_state base;
+};
+
+static struct fixture fixture;
+/* failed checks of the current test */
+static unsigned int fails;
+
+static const u8 test_mac[ETH_ALEN] = { 0x00, 0x0c, 0x29, 0x12, 0x34, 0x56 };
+static const u8 peer_mac[ETH_ALEN] = { 0x00, 0x0c, 0x29, 0xab, 0xcd, 0xef };
+static const u8 mcast_mac[ETH_ALEN] = { 0x01, 0x00, 0x5e, 0x00, 0x00, 0x01 };
+
+#define CHECK(c)							\
+	do {								\
+		if (!(c)) {						\
+			fails++;					\
+			printf("# %s:%d: %s\n", __FILE__, __LINE__, #c); \
+		}							\
+	} while (0)
+
+#define CHECK_EQ(a, b)							\
+	do {								\
+		long long __a = (a), __b = (b);				\
+		if (__a != __b) {					\
+			fails++;					\
+			printf("# %s:%d: %s == %lld, expected %lld\n",	\
+					__FILE__, __LINE__, #a, __a, __b); \
+		}							\
+	} while (0)
+
+/* Ethernet header to 'dst' and a payload derived from 'seed' */
+static void frame_fill(u8 *p, unsigned int len, const u8 *dst,
+		const u8 *src, u8 seed)
+{
+	unsigned int i;
+
+	memcpy(p, dst, ETH_ALEN);
+	memcpy(p + ETH_ALEN, src, ETH_ALEN);
+	p[12] = 0x08;
+	p[13] = 0x00;
+	for (i = ETH_HLEN; i < len; i++)
+		p[i] = seed + i;
+}
+
+static bool frame_equal(const u8 *p, unsigned int len, const u8 *dst,
+		const u8 *src, u8 seed)
+{
+	u8 frame[PCNET_MODEL_FRAME_MAX];
+
+	frame_fill(frame, len, dst, src, seed);
+	return !memcmp(p, frame, len);
+}
+
+static struct sk_buff *tx_skb(unsigned int len, u8 seed)
+{
+	struct sk_buff *skb = kshim_alloc_skb(len);
+
+	if (skb)
+		frame_fill(skb_put(skb, len), len, peer_mac, test_mac, seed);
+	return skb;
+}
+
+/* a linear part and page fragments of the given lengths */
+static struct sk_buff *tx_skb_frags(unsigned int head,
+		const unsigned int *frag, unsigned int nr_frags, u8 seed)
+{
+	unsigned int len = head, f, off;
+	u8 frame[PCNET_MODEL_FRAME_MAX];
+	struct sk_buff *skb;
+	skb_frag_t *sf;
+
+	for (f = 0; f < nr_frags; f++)
+		len += frag[f];
+	frame_fill(frame, len, peer_mac, test_mac, seed);
+	skb = kshim_alloc_skb(head);
+	memcpy(skb_put(skb, head), frame, head);
+	for (f = 0, off = head; f < nr_frags; off += frag[f++]) {
+		sf = &skb_shinfo(skb)->frags[f];
+		sf->page = alloc_page(GFP_KERNEL);
+		sf->page_offset = 100;
+		sf->size = frag[f];
+		memcpy(page_address(sf->page) + sf->page_offset, frame + off,
+				frag[f]);
+	}
+	skb_shinfo(skb)->nr_frags = nr_frags;
+	skb->len = len;
+	skb->data_len = len - head;
+	return skb;
+}
+
+static netdev_tx_t xmit(struct fixture *fx, unsigned int len, u8 seed)
+{
+	struct sk_buff *skb = tx_skb(len, seed);
+	netdev_tx_t rc = kshim_xmit(fx->ndev, skb);
+
+	if (rc != NETDEV_TX_OK)
+		consume_skb(skb);
+	return rc;
+}
+
+static enum pcnet_model_rx rx(struct fixture *fx, const u8 *dst,
+		unsigned int len, u8 seed)
+{
+	u8 frame[PCNET_MODEL_FRAME_MAX];
+
+	frame_fill(frame, len, dst, peer_mac, seed);
+	return pcnet_model_rx(&fx->m, frame, len);
+}
+
+static struct rtnl_link_stats64 stats(struct fixture *fx)
+{
+	struct rtnl_link_stats64 s;
+
+	memset(&s, 0, sizeof(s));
+	fx->ndev->netdev_ops->ndo_get_stats64(fx->ndev, &s);
+	return s;
+}
+
+/* interrupts, polls and interrupt hold-offs until all is quiet */
+static void settle(void)
+{
+	kshim_advance(PCNET_ITR_MAX_USECS * NSEC_PER_USEC);
+}
+
+static int fx_probe(struct fixture *fx)
+{
+	int rc = kshim_pci_probe(fx->pdev);
+
+	if (!rc) {
+		fx->ndev = pci_get_drvdata(fx->pdev);
+		fx->pp = netdev_priv(fx->ndev);
+	}
+	return rc;
+}
+
+static void fx_up(struct fixture *fx)
+{
+	CHECK_EQ(fx_probe(fx), 0);
+	CHECK_EQ(kshim_dev_open(fx->ndev), 0);
+	kshim_run();
+}
+
+/*
+ * Tests
+ */
+
+static void test_probe_dword(struct fixture *fx)
+{
+	CHECK_EQ(fx_probe(fx), 0);
+	CHECK(fx->pp->dwio);
+	CHECK(fx->pp->mmio);
+	CHECK(fx->m.dwio);
+	CHECK_EQ(pcnet_wio_key.enabled, 0);
+	CHECK(!memcmp(fx->ndev->dev_addr, test_mac, ETH_ALEN));
+	CHECK(!pcnet_model_running(&fx->m));
+}
+
+static void test_probe_word(struct fixture *fx)
+{
+	fx->m.no_dwio = true;
+	fx_up(fx);
+	CHECK(!fx->pp->dwio);
+	CHECK(!fx->m.dwio);
+	CHECK_EQ(pcnet_wio_key.enabled, 1);
+	CHECK(pcnet_model_running(&fx->m));
+	CHECK_EQ(xmit(fx, 100, 1), NETDEV_TX_OK);
+	CHECK_EQ(fx->m.st.tx_frames, 1);
+}
+
+/* the word I/O key is dropped again when the word mode reset fails */
+static void test_probe_word_reset_fail(struct fixture *fx)
+{
+	fx->m.no_dwio = true;
+	/* the reset of the detection passes, the word mode one fails */
+	fx->m.reset_fail = 2;
+	CHECK_EQ(fx_probe(fx), -ENODEV);
+	CHECK_EQ(pcnet_wio_key.enabled, 0);
+}
+
+static void test_probe_mmio_fallback(struct fixture *fx)
+{
+	fx->pdev->fail_mmio = true;
+	fx_up(fx);
+	CHECK(!fx->pp->mmio);
+	CHECK(fx->pp->dwio);
+	CHECK_EQ(xmit(fx, 100, 1), NETDEV_TX_OK);
+	CHECK_EQ(fx->m.st.tx_frames, 1);
+}
+
+static void test_open(struct fixture *fx)
+{
+	unsigned int i;
+	u16 *status;
+
+	fx_up(fx);
+	CHECK(fx->m.inited);
+	CHECK(pcnet_model_running(&fx->m));
+	CHECK_EQ(fx->m.rx_len, PCNET_RING_DEFAULT);
+	CHECK_EQ(fx->m.tx_len, PCNET_RING_DEFAULT);
+	CHECK_EQ(fx->m.bcr[BCR20], BCR20_SWSTYLE_PCNET_PCI);
+	CHECK(fx->m.csr[CSR4] & CSR4_APAD_XMT);
+	CHECK_EQ(fx->m.csr[12], test_mac[0] | test_mac[1] << 8);
+	CHECK_EQ(fx->m.csr[14], test_mac[4] | test_mac[5] << 8);
+	CHECK_EQ(fx->m.csr[CSR15], 0);
+	/* TX completions are reclaimed lazily */
+	CHECK(fx->m.csr[CSR3] & CSR3_TINTM);
+	CHECK(!(fx->m.csr[CSR3] & CSR3_RINTM));
+	CHECK(fx->m.csr[CSR0] & CSR0_IENA);
+	for (i = 0; i < fx->m.rx_len; i++) {
+		status = (u16 *)pcnet_model_rx_desc(&fx->m, i) + 3;
+		CHECK(*status & DESC_OWN);
+	}
+	/* IDON has been acknowledged */
+	CHECK(!(fx->m.csr[CSR0] & CSR0_IDON));
+}
+
+/* a copied frame is released as consumed, not dropped */
+static void test_xmit_bounce(struct fixture *fx)
+{
+	const struct pcnet_model_frame *f;
+	struct rtnl_link_stats64 s;
+	long dma_maps;
+
+	fx_up(fx);
+	dma_maps = kshim.dma_maps;
+	CHECK_EQ(xmit(fx, 100, 7), NETDEV_TX_OK);
+	CHECK_EQ(kshim.skbs, fx->base.skbs);
+	CHECK_EQ(kshim.dma_maps, dma_maps);
+	CHECK_EQ(kshim.skbs_dropped, fx->base.skbs_dropped);
+	CHECK_EQ(fx->m.st.tx_frames, 1);
+	f = pcnet_model_tx_last(&fx->m, 0);
+	CHECK_EQ(f->len, 100);
+	CHECK(frame_equal(f->data, 100, peer_mac, test_mac, 7));
+
+	/* runts are padded by the controller */
+	CHECK_EQ(xmit(fx, 42, 8), NETDEV_TX_OK);
+	f = pcnet_model_tx_last(&fx->m, 0);
+	CHECK_EQ(f->len, ETH_ZLEN);
+	CHECK(frame_equal(f->data, 42, peer_mac, test_mac, 8));
+
+	settle();
+	s = stats(fx);
+	CHECK_EQ(s.tx_packets, 2);
+	CHECK_EQ(s.tx_bytes, 142);
+	CHECK_EQ(kshim.skbs_dropped, fx->base.skbs_dropped);
+}
+
+static void test_xmit_frags(struct fixture *fx)
+{
+	static const unsigned int frag[] = { 500, 600 };
+	const struct pcnet_model_frame *f;
+	struct sk_buff *skb;
+	long dma_maps;
+
+	fx_up(fx);
+	dma_maps = kshim.dma_maps;
+	skb = tx_skb_frags(300, frag, ARRAY_SIZE(frag), 3);
+	CHECK_EQ(kshim_xmit(fx->ndev, skb), NETDEV_TX_OK);
+	CHECK_EQ(fx->m.st.tx_frames, 1);
+	f = pcnet_model_tx_last(&fx->m, 0);
+	CHECK_EQ(f->len, 1400);
+	CHECK(frame_equal(f->data, 1400, peer_mac, test_mac, 3));
+	/* reclaimed by start_xmit itself, the model sends at once */
+	CHECK_EQ(kshim.skbs, fx->base.skbs);
+	CHECK_EQ(kshim.dma_maps, dma_maps);
+	CHECK_EQ(kshim.pages, fx->base.pages + PCNET_RING_DEFAULT);
+}
+
+static void test_xmit_error(struct fixture *fx)
+{
+	struct rtnl_link_stats64 s;
+
+	fx_up(fx);
+	fx->m.tx_error = 1;
+	fx->m.tx_error_flags = TMD2_LCAR | TMD2_RTRY;
+	CHECK_EQ(xmit(fx, 400, 1), NETDEV_TX_OK);
+	CHECK_EQ(xmit(fx, 400, 2), NETDEV_TX_OK);
+	settle();
+	s = stats(fx);
+	CHECK_EQ(s.tx_errors, 1);
+	CHECK_EQ(s.tx_carrier_errors, 1);
+	CHECK_EQ(s.tx_aborted_errors, 1);
+	CHECK_EQ(s.tx_packets, 1);
+	CHECK_EQ(s.tx_bytes, 400);
+}
+
+/* completions of a burst are reclaimed by the timer while TINT is off */
+static void test_xmit_timer_reclaim(struct fixture *fx)
+{
+	struct rtnl_link_stats64 s;
+	unsigned int i;
+
+	fx_up(fx);
+	fx->m.tx_hold = true;
+	for (i = 0; i < 3; i++)
+		CHECK_EQ(xmit(fx, 400, i), NETDEV_TX_OK);
+	CHECK_EQ(fx->m.st.tx_frames, 0);
+	CHECK_EQ(kshim.skbs, fx->base.skbs + 3);
+	CHECK_EQ(pcnet_model_tx_run(&fx->m, ~0U), 3);
+	kshim_run();
+	/* TINT is masked, nothing has been reclaimed yet */
+	CHECK_EQ(kshim.skbs, fx->base.skbs + 3);
+	CHECK(timer_pending(&fx->pp->tx_timer));
+	kshim_advance(PCNET_TX_RECLAIM_MSECS * NSEC_PER_MSEC);
+	CHECK_EQ(kshim.skbs, fx->base.skbs);
+	s = stats(fx);
+	CHECK_EQ(s.tx_packets, 3);
+	CHECK_EQ(s.tx_bytes, 1200);
+}
+
+/* a frame arriving while a timer scheduled poll completes */
+static void timer_poll_hook(struct napi_struct *napi)
+{
+	struct fixture *fx = &fixture;
+
+	kshim.napi_complete_hook = NULL;
+	CHECK_EQ(rx(fx, test_mac, 100, 1), PCNET_MODEL_RX_OK);
+	kshim_irq(fx->pdev);
+}
+
+/* The timer polls with interrupts off like the ISR does, an interrupt
+ * during that poll must not be taken and lost.
+ */
+static void test_xmit_timer_poll_irq(struct fixture *fx)
+{
+	fx_up(fx);
+	fx->m.tx_hold = true;
+	CHECK_EQ(xmit(fx, 400, 0), NETDEV_TX_OK);
+	CHECK(timer_pending(&fx->pp->tx_timer));
+	kshim.napi_complete_hook = timer_poll_hook;
+	kshim_advance(PCNET_TX_RECLAIM_MSECS * NSEC_PER_MSEC);
+	CHECK(!kshim.napi_complete_hook);
+	settle();
+	CHECK_EQ(fx->ndev->rx_count, 1);
+
+	CHECK_EQ(pcnet_model_tx_run(&fx->m, ~0U), 1);
+	kshim_advance(PCNET_TX_RECLAIM_MSECS * NSEC_PER_MSEC);
+	CHECK_EQ(fx->pp->tx.dirty, fx->pp->tx.cur);
+	CHECK(fx->m.csr[CSR0] & CSR0_IENA);
+}
+
+/* TINT is unmasked above the high watermark and masked again once the
+ * ring has been drained
+ */
+static void test_xmit_hiwat(struct fixture *fx)
+{
+	struct pcnet_private *pp;
+	struct rtnl_link_stats64 s;
+	unsigned int n;
+
+	fx_up(fx);
+	pp = fx->pp;
+	fx->m.tx_hold = true;
+	for (n = 0; n < PCNET_TX_HIWAT(pp) - 1; n++)
+		CHECK_EQ(xmit(fx, 400, n), NETDEV_TX_OK);
+	CHECK(!pp->tx_tint);
+	CHECK(fx->m.csr[CSR3] & CSR3_TINTM);
+	CHECK_EQ(xmit(fx, 400, n++), NETDEV_TX_OK);
+	CHECK(pp->tx_tint);
+	CHECK(!(fx->m.csr[CSR3] & CSR3_TINTM));
+
+	while (!netif_queue_stopped(fx->ndev) && n < PCNET_RING_DEFAULT)
+		CHECK_EQ(xmit(fx, 400, n++), NETDEV_TX_OK);
+	CHECK_EQ(n, PCNET_RING_DEFAULT - PCNET_TX_DESC_MAX + 1);
+	CHECK_EQ(xmit(fx, 400, n), NETDEV_TX_BUSY);
+
+	CHECK_EQ(pcnet_model_tx_run(&fx->m, ~0U), n);
+	kshim_run();
+	CHECK(!netif_queue_stopped(fx->ndev));
+	CHECK_EQ(fx->ndev->txq.wakeups, 1);
+	CHECK_EQ(pp->tx.cur, pp->tx.dirty);
+	CHECK(!pp->tx_tint);
+	CHECK(fx->m.csr[CSR3] & CSR3_TINTM);
+	s = stats(fx);
+	CHECK_EQ(s.tx_packets, n);
+	CHECK_EQ(kshim.skbs, fx->base.skbs);
+}
+
+/* A queue stopped by BQL below the high watermark is woken by TINT,
+ * without waiting for the reclaim timer.
+ */
+static void test_xmit_bql(struct fixture *fx)
+{
+	struct pcnet_private *pp;
+	unsigned int i;
+
+	fx_up(fx);
+	pp = fx->pp;
+	fx->ndev->txq.limit = 1000;
+	fx->m.tx_hold = true;
+	for (i = 0; i < 3; i++)
+		CHECK_EQ(xmit(fx, 400, i), NETDEV_TX_OK);
+	CHECK(netif_xmit_stopped(&fx->ndev->txq));
+	CHECK(!netif_queue_stopped(fx->ndev));
+	CHECK(pp->tx.cur - pp->tx.dirty < PCNET_TX_HIWAT(pp));
+	CHECK(pp->tx_tint);
+	CHECK(!(fx->m.csr[CSR3] & CSR3_TINTM));
+
+	CHECK_EQ(pcnet_model_tx_run(&fx->m, ~0U), 3);
+	kshim_run();
+	CHECK(!netif_xmit_stopped(&fx->ndev->txq));
+	CHECK_EQ(fx->ndev->txq.wakeups, 1);
+	CHECK_EQ(fx->ndev->txq.inflight, 0);
+	CHECK(!pp->tx_tint);
+	CHECK_EQ(kshim.skbs, fx->base.skbs);
+}
+
+static void test_rx_copybreak(struct fixture *fx)
+{
+	struct rtnl_link_stats64 s;
+	struct sk_buff *skb;
+
+	fx_up(fx);
+	CHECK_EQ(rx(fx, test_mac, 100, 5), PCNET_MODEL_RX_OK);
+	kshim_run();
+	skb = kshim_rx_pop(fx->ndev);
+	CHECK(skb);
+	if (!skb)
+		return;
+	CHECK_EQ(skb->len, 100);
+	CHECK(!skb->head_frag);
+	CHECK(frame_equal(skb->data, 100, test_mac, peer_mac, 5));
+	consume_skb(skb);
+	CHECK_EQ(fx->pp->rx_pages_recycled, 0);
+	CHECK_EQ(fx->pp->rx_pages_alloc, 0);
+	CHECK(le16_to_cpu(fx->pp->rx.desc[0].status) & DESC_OWN);
+	s = stats(fx);
+	CHECK_EQ(s.rx_packets, 1);
+	CHECK_EQ(s.rx_bytes, 100);
+}
+
+/* Large frames are passed up in their page. The slot flips to the other
+ * half of the page while the stack holds one, and gets a new page once
+ * it comes around with both halves in use.
+ */
+static void test_rx_page_flip(struct fixture *fx)
+{
+	struct sk_buff *held, *skb;
+	unsigned int i, n;
+
+	fx_up(fx);
+	n = fx->pp->rx.size;
+	CHECK_EQ(rx(fx, test_mac, 1000, 0), PCNET_MODEL_RX_OK);
+	kshim_run();
+	held = kshim_rx_pop(fx->ndev);
+	CHECK(held && held->head_frag && held->len == 1000);
+	if (!held)
+		return;
+	CHECK(frame_equal(held->data, 1000, test_mac, peer_mac, 0));
+	CHECK_EQ(fx->pp->rx_pages_recycled, 1);
+
+	for (i = 1; i <= n; i++) {
+		CHECK_EQ(rx(fx, test_mac, 1000, i), PCNET_MODEL_RX_OK);
+		settle();
+		skb = kshim_rx_pop(fx->ndev);
+		CHECK(skb && frame_equal(skb->data, 1000, test_mac, peer_mac,
+					i));
+		consume_skb(skb);
+	}
+	CHECK_EQ(fx->pp->rx_pages_recycled, n);
+	CHECK_EQ(fx->pp->rx_pages_alloc, 1);
+	consume_skb(held);
+	CHECK_EQ(kshim.pages, fx->base.pages + n);
+	CHECK_EQ(stats(fx).rx_packets, n + 1);
+}
+
+/* a failed refill drops the frame and keeps the old page in the ring */
+static void test_rx_refill_fail(struct fixture *fx)
+{
+	struct sk_buff *held;
+	unsigned int i, n, round;
+	long pages;
+
+	fx_up(fx);
+	n = fx->pp->rx.size;
+	for (round = 0; round < 2; round++) {
+		CHECK_EQ(rx(fx, test_mac, 1000, 0), PCNET_MODEL_RX_OK);
+		settle();
+		held = kshim_rx_pop(fx->ndev);
+		CHECK(held);
+		for (i = 1; i < n; i++)
+			CHECK_EQ(rx(fx, test_mac, 1000, i), PCNET_MODEL_RX_OK);
+		settle();
+		kshim_rx_purge(fx->ndev);
+
+		/* back at the slot whose other half is held */
+		pages = kshim.pages;
+		if (round)
+			kshim.fail_dma_map = 1;
+		else
+			kshim.fail_alloc_page = 1;
+		CHECK_EQ(rx(fx, test_mac, 1000, 0), PCNET_MODEL_RX_OK);
+		settle();
+		CHECK(!kshim_rx_pop(fx->ndev));
+		CHECK_EQ(kshim.pages, pages);
+		CHECK_EQ(fx->ndev->stats.rx_dropped, round + 1);
+		CHECK(le16_to_cpu(fx->pp->rx.desc[(fx->pp->rx.cur - 1) &
+					(n - 1)].status) & DESC_OWN);
+		consume_skb(held);
+	}
+	CHECK_EQ(kshim.fail_alloc_page, 0);
+	CHECK_EQ(kshim.fail_dma_map, 0);
+	CHECK_EQ(fx->pp->rx_pages_alloc, 0);
+	/* the ring still works */
+	CHECK_EQ(rx(fx, test_mac, 1000, 9), PCNET_MODEL_RX_OK);
+	settle();
+	CHECK_EQ(fx->ndev->rx_count, 1);
+}
+
+static void test_rx_errors(struct fixture *fx)
+{
+	struct rtnl_link_stats64 s;
+	unsigned int i;
+
+	fx_up(fx);
+	fx->m.rx_error = DESC_RX_CRC;
+	CHECK_EQ(rx(fx, test_mac, 100, 0), PCNET_MODEL_RX_OK);
+	/* shorter than the minimum frame */
+	CHECK_EQ(rx(fx, test_mac, 40, 0), PCNET_MODEL_RX_OK);
+	CHECK_EQ(rx(fx, peer_mac, 100, 0), PCNET_MODEL_RX_FILTERED);
+	settle();
+	CHECK_EQ(fx->ndev->rx_count, 0);
+	s = stats(fx);
+	CHECK_EQ(s.rx_errors, 2);
+	CHECK_EQ(s.rx_crc_errors, 1);
+	CHECK_EQ(s.rx_length_errors, 1);
+
+	/* the ring fills up while nothing is polled */
+	for (i = 0; i < fx->pp->rx.size; i++)
+		CHECK_EQ(rx(fx, test_mac, 100, i), PCNET_MODEL_RX_OK);
+	CHECK_EQ(rx(fx, test_mac, 100, i), PCNET_MODEL_RX_MISSED);
+	settle();
+	CHECK_EQ(fx->ndev->rx_count, fx->pp->rx.size);
+	s = stats(fx);
+	CHECK_EQ(s.rx_missed_errors, 1);
+	CHECK_EQ(s.rx_packets, fx->pp->rx.size);
+	CHECK_EQ(rx(fx, test_mac, 100, 0), PCNET_MODEL_RX_OK);
+}
+
+static void set_rx_mode(struct fixture *fx)
+{
+	rtnl_lock();
+	fx->ndev->netdev_ops->ndo_set_rx_mode(fx->ndev);
+	rtnl_unlock();
+}
+
+/* The filter is loaded with the controller suspended. The lock is not
+ * held while waiting, so interrupts stay enabled.
+ */
+static void test_rx_filter(struct fixture *fx)
+{
+	static const u8 other_mcast[ETH_ALEN] = {
+		0x01, 0x00, 0x5e, 0x00, 0x00, 0x02
+	};
+	static const u8 other_mac[ETH_ALEN] = {
+		0x00, 0x0c, 0x29, 0x00, 0x00, 0x01
+	};
+	unsigned int warn;
+
+	fx_up(fx);
+	fx->m.spnd_delay_us = 200;
+	CHECK_EQ(rx(fx, mcast_mac, 100, 0), PCNET_MODEL_RX_FILTERED);
+
+	memcpy(fx->ndev->mc[0].addr, mcast_mac, ETH_ALEN);
+	fx->ndev->mc_count = 1;
+	kshim_irqoff_max_ns = 0;
+	set_rx_mode(fx);
+	CHECK(kshim_irqoff_max_ns < 10 * NSEC_PER_USEC);
+	CHECK(!fx->m.suspended);
+	CHECK_EQ(rx(fx, mcast_mac, 100, 0), PCNET_MODEL_RX_OK);
+	CHECK_EQ(rx(fx, other_mcast, 100, 0), PCNET_MODEL_RX_FILTERED);
+	CHECK_EQ(rx(fx, other_mac, 100, 0), PCNET_MODEL_RX_FILTERED);
+
+	fx->ndev->flags |= IFF_PROMISC;
+	set_rx_mode(fx);
+	CHECK(fx->m.csr[CSR15] & CSR15_PROM);
+	CHECK_EQ(rx(fx, other_mac, 100, 0), PCNET_MODEL_RX_OK);
+	settle();
+	CHECK_EQ(fx->ndev->rx_count, 2);
+
+	/* a controller that doesn't suspend keeps the old filter */
+	fx->m.spnd_delay_us = 1000000;
+	fx->ndev->flags &= ~IFF_PROMISC;
+	warn = kshim.messages[KSHIM_LOG_WARN];
+	set_rx_mode(fx);
+	CHECK_EQ(kshim.messages[KSHIM_LOG_WARN], warn + 1);
+	CHECK(fx->m.csr[CSR15] & CSR15_PROM);
+	/* the next INIT loads it */
+	CHECK(!(fx->pp->init_block->mode & CSR15_PROM));
+}
+
+static int set_ringparam(struct fixture *fx, u32 rx_pending, u32 tx_pending)
+{
+	struct ethtool_ringparam ering;
+	int rc;
+
+	memset(&ering, 0, sizeof(ering));
+	ering.rx_pending = rx_pending;
+	ering.tx_pending = tx_pending;
+	rtnl_lock();
+	rc = fx->ndev->ethtool_ops->set_ringparam(fx->ndev, &ering);
+	rtnl_unlock();
+	return rc;
+}
+
+static void test_ringparam(struct fixture *fx)
+{
+	struct ethtool_ringparam ering;
+	u64 resets;
+
+	fx_up(fx);
+	memset(&ering, 0, sizeof(ering));
+	fx->ndev->ethtool_ops->get_ringparam(fx->ndev, &ering);
+	CHECK_EQ(ering.rx_pending, PCNET_RING_DEFAULT);
+	CHECK_EQ(ering.rx_max_pending, PCNET_RING_MAX);
+
+	CHECK_EQ(set_ringparam(fx, 200, 40), 0);
+	CHECK_EQ(fx->m.rx_len, 256);
+	CHECK_EQ(fx->m.tx_len, 64);
+	CHECK_EQ(kshim.pages, fx->base.pages + 256);
+	CHECK_EQ(rx(fx, test_mac, 1000, 1), PCNET_MODEL_RX_OK);
+	CHECK_EQ(xmit(fx, 1000, 1), NETDEV_TX_OK);
+	settle();
+	CHECK_EQ(fx->ndev->rx_count, 1);
+	CHECK_EQ(fx->m.st.tx_frames, 1);
+
+	/* out of range sizes are refused, not clamped */
+	CHECK_EQ(set_ringparam(fx, PCNET_RING_MAX + 1, 64), -EINVAL);
+	CHECK_EQ(set_ringparam(fx, 256, 1024), -EINVAL);
+	CHECK_EQ(set_ringparam(fx, 1, 1), 0);
+	CHECK_EQ(fx->m.rx_len, PCNET_RING_MIN);
+	CHECK_EQ(fx->m.tx_len, PCNET_RING_MIN);
+
+	/* the old rings stay in use if the new ones can't be allocated */
+	kshim.fail_coherent = 1;
+	CHECK_EQ(set_ringparam(fx, 64, 64), -ENOMEM);
+	CHECK_EQ(fx->m.rx_len, PCNET_RING_MIN);
+	CHECK_EQ(rx(fx, test_mac, 1000, 2), PCNET_MODEL_RX_OK);
+	settle();
+	CHECK_EQ(fx->ndev->rx_count, 2);
+
+	/* a failed initialization is retried after a reset */
+	resets = fx->m.st.resets;
+	fx->m.init_fail = 1;
+	CHECK_EQ(set_ringparam(fx, 64, 64), 0);
+	CHECK_EQ(fx->m.st.resets, resets + 1);
+	CHECK(pcnet_model_running(&fx->m));
+	CHECK_EQ(fx->m.rx_len, 64);
+	CHECK_EQ(rx(fx, test_mac, 1000, 3), PCNET_MODEL_RX_OK);
+	CHECK_EQ(xmit(fx, 1000, 2), NETDEV_TX_OK);
+	settle();
+	CHECK_EQ(fx->ndev->rx_count, 3);
+	CHECK_EQ(fx->m.st.tx_frames, 2);
+
+	/* if that fails too, the interface stays up for a later retry */
+	fx->m.init_fail = 1;
+	fx->m.reset_fail = 1;
+	CHECK_EQ(set_ringparam(fx, 128, 128), -ETIMEDOUT);
+	CHECK(!pcnet_model_running(&fx->m));
+	CHECK(!netif_xmit_stopped(&fx->ndev->txq));
+	CHECK(!test_bit(NAPI_STATE_SCHED, &fx->pp->napi.state));
+	CHECK_EQ(fx->pp->rx_pending, 128);
+
+	/* applied by the next open */
+	kshim_dev_close(fx->ndev);
+	CHECK_EQ(set_ringparam(fx, 512, 512), 0);
+	CHECK_EQ(kshim_dev_open(fx->ndev), 0);
+	CHECK_EQ(fx->m.rx_len, 512);
+	CHECK_EQ(fx->m.tx_len, 512);
+}
+
+static int set_coalesce(struct fixture *fx, struct ethtool_coalesce *ec)
+{
+	return fx->ndev->ethtool_ops->set_coalesce(fx->ndev, ec);
+}
+
+static void test_coalesce(struct fixture *fx)
+{
+	struct ethtool_coalesce ec;
+
+	fx_up(fx);
+	memset(&ec, 0, sizeof(ec));
+	fx->ndev->ethtool_ops->get_coalesce(fx->ndev, &ec);
+	CHECK(ec.use_adaptive_rx_coalesce);
+
+	memset(&ec, 0, sizeof(ec));
+	ec.rx_max_coalesced_frames = 8;
+	CHECK_EQ(set_coalesce(fx, &ec), -EOPNOTSUPP);
+	memset(&ec, 0, sizeof(ec));
+	ec.tx_coalesce_usecs = 8;
+	CHECK_EQ(set_coalesce(fx, &ec), -EOPNOTSUPP);
+	memset(&ec, 0, sizeof(ec));
+	ec.rx_coalesce_usecs = PCNET_ITR_MAX_USECS + 1;
+	CHECK_EQ(set_coalesce(fx, &ec), -EINVAL);
+
+	/* a fixed hold-off after every poll */
+	memset(&ec, 0, sizeof(ec));
+	ec.rx_coalesce_usecs = 100;
+	CHECK_EQ(set_coalesce(fx, &ec), 0);
+	CHECK_EQ(rx(fx, test_mac, 100, 0), PCNET_MODEL_RX_OK);
+	kshim_run();
+	CHECK_EQ(fx->ndev->rx_count, 1);
+	CHECK(fx->m.csr[CSR3] & CSR3_RINTM);
+	CHECK_EQ(rx(fx, test_mac, 100, 1), PCNET_MODEL_RX_OK);
+	kshim_run();
+	CHECK_EQ(fx->ndev->rx_count, 1);
+	kshim_advance(100 * NSEC_PER_USEC);
+	CHECK_EQ(fx->ndev->rx_count, 2);
+}
+
+/* the controller is reset once the interface is gone */
+static void test_remove(struct fixture *fx)
+{
+	u64 resets;
+
+	fx_up(fx);
+	CHECK_EQ(xmit(fx, 100, 1), NETDEV_TX_OK);
+	CHECK_EQ(rx(fx, test_mac, 1000, 1), PCNET_MODEL_RX_OK);
+	resets = fx->m.st.resets;
+	kshim_pci_remove(fx->pdev);
+	fx->ndev = NULL;
+	CHECK_EQ(fx->m.st.resets, resets + 1);
+	CHECK_EQ(fx->m.csr[CSR0], CSR0_STOP);
+}
+
+static const struct {
+	const char *name;
+	void (*fn)(struct fixture *fx);
+} tests[] = {
+	{ "probe_dword", test_probe_dword },
+	{ "probe_word", test_probe_word },
+	{ "probe_word_reset_fail", test_probe_word_reset_fail },
+	{ "probe_mmio_fallback", test_probe_mmio_fallback },
+	{ "open", test_open },
+	{ "xmit_bounce", test_xmit_bounce },
+	{ "xmit_frags", test_xmit_frags },
+	{ "xmit_error", test_xmit_error },
+	{ "xmit_timer_reclaim", test_xmit_timer_reclaim },
+	{ "xmit_timer_poll_irq", test_xmit_timer_poll_irq },
+	{ "xmit_hiwat", test_xmit_hiwat },
+	{ "xmit_bql", test_xmit_bql },
+	{ "rx_copybreak", test_rx_copybreak },
+	{ "rx_page_flip", test_rx_page_flip },
+	{ "rx_refill_fail", test_rx_refill_fail },
+	{ "rx_errors", test_rx_errors },
+	{ "rx_filter", test_rx_filter },
+	{ "ringparam", test_ringparam },
+	{ "coalesce", test_coalesce },
+	{ "remove", test_remove },
+};
+
+static void fx_setup(struct fixture *fx)
+{
+	pcnet_model_init(&fx->m, test_mac);
+	fx->pdev = kshim_pci_create(&pcnet_model_pci_ops, &fx->m);
+	fx->ndev = NULL;
+	fx->pp = NULL;
+	fx->base = kshim;
+}
+
+/* removes the device and checks that nothing is left behind */
+static void fx_teardown(struct fixture *fx)
+{
+	if (fx->ndev) {
+		kshim_rx_purge(fx->ndev);
+		kshim_pci_remove(fx->pdev);
+		CHECK(!pcnet_model_running(&fx->m));
+	}
+	kshim_pci_destroy(fx->pdev);
+
+	CHECK_EQ(kshim.pages, fx->base.pages);
+	CHECK_EQ(kshim.skbs, fx->base.skbs);
+	CHECK_EQ(kshim.allocs, fx->base.allocs);
+	CHECK_EQ(kshim.dma_maps, fx->base.dma_maps);
+	CHECK_EQ(kshim.timers, fx->base.timers);
+	CHECK_EQ(kshim.rtnl, 0);
+	CHECK_EQ(kshim.bugs, fx->base.bugs);
+	CHECK_EQ(pcnet_wio_key.enabled, 0);
+	CHECK_EQ(pcnet_hist_key.enabled, 0);
+	CHECK_EQ(fx->m.st.violations, 0);
+	CHECK_EQ(fx->m.st.dma_faults, 0);
+}
+
+static int run_tests(void)
+{
+	struct fixture *fx = &fixture;
+	unsigned int i, failed = 0;
+
+	printf("1..%zu\n", ARRAY_SIZE(tests));
+	for (i = 0; i < ARRAY_SIZE(tests); i++) {
+		fails = 0;
+		fx_setup(fx);
+		tests[i].fn(fx);
+		fx_teardown(fx);
+		printf("%s %u - %s\n", fails ? "not ok" : "ok", i + 1,
+				tests[i].name);
+		if (fails)
+			failed++;
+	}
+	return failed ? 1 : 0;
+}
+
+/*
+ * Benchmarks: host time and register accesses per frame. The model
+ * costs nothing in comparison to a real controller, so register
+ * accesses are the number that carries over to hardware.
+ */
+
+static u64 bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static u64 bench_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static void bench_sink(struct pcnet_model *m, const u8 *data,
+		unsigned int len)
+{
+}
+
+struct bench_mark {
+	u64 ns;
+	u64 cycles;
+	u64 reads;
+	u64 writes;
+	u64 rap_writes;
+};
+
+static void bench_start(struct fixture *fx, struct bench_mark *b)
+{
+	b->reads = fx->pp->regs.reads;
+	b->writes = fx->pp->regs.writes;
+	b->rap_writes = fx->pp->regs.rap_writes;
+	b->cycles = bench_cycles();
+	b->ns = bench_now_ns();
+}
+
+static void bench_end(struct fixture *fx, struct bench_mark *b,
+		const char *name, unsigned int frames)
+{
+	u64 ns = bench_now_ns() - b->ns;
+	u64 cycles = bench_cycles() - b->cycles;
+
+	printf("%-16s %8.1f ns %8.1f cycles %6.2f reads %6.2f writes "
+			"%6.2f RAP writes per frame\n", name,
+			(double)ns / frames, (double)cycles / frames,
+			(double)(fx->pp->regs.reads - b->reads) / frames,
+			(double)(fx->pp->regs.writes - b->writes) / frames,
+			(double)(fx->pp->regs.rap_writes - b->rap_writes) /
+			frames);
+}
+
+static void bench_tx(struct fixture *fx, const char *name, unsigned int len,
+		unsigned int frames)
+{
+	u8 frame[PCNET_MODEL_FRAME_MAX];
+	struct sk_buff *skb;
+	struct bench_mark b;
+	unsigned int i;
+
+	frame_fill(frame, len, peer_mac, test_mac, 0);
+	bench_start(fx, &b);
+	for (i = 0; i < frames; i++) {
+		skb = kshim_alloc_skb(len);
+		memcpy(skb_put(skb, len), frame, len);
+		if (kshim_xmit(fx->ndev, skb) != NETDEV_TX_OK) {
+			consume_skb(skb);
+			settle();
+		}
+	}
+	settle();
+	bench_end(fx, &b, name, frames);
+}
+
+static void bench_rx(struct fixture *fx, const char *name, unsigned int len,
+		unsigned int frames, unsigned int burst)
+{
+	u8 frame[PCNET_MODEL_FRAME_MAX];
+	struct bench_mark b;
+	unsigned int i;
+
+	frame_fill(frame, len, test_mac, peer_mac, 0);
+	bench_start(fx, &b);
+	for (i = 0; i < frames; i++) {
+		pcnet_model_rx(&fx->m, frame, len);
+		if ((i + 1) % burst == 0) {
+			settle();
+			kshim_rx_purge(fx->ndev);
+		}
+	}
+	settle();
+	kshim_rx_purge(fx->ndev);
+	bench_end(fx, &b, name, frames);
+}
+
+static int run_bench(void)
+{
+	struct fixture *fx = &fixture;
+	unsigned int frames = 200000;
+
+	fails = 0;
+	fx_setup(fx);
+	fx_up(fx);
+	fx->m.tx_frame = bench_sink;
+	bench_tx(fx, "tx 64 bounce", 64, frames);
+	bench_tx(fx, "tx 1514 mapped", 1514, frames);
+	bench_rx(fx, "rx 64 copy", 64, frames, 16);
+	bench_rx(fx, "rx 1514 page", 1514, frames, 16);
+	bench_rx(fx, "rx 64 single", 64, frames, 1);
+	fx_teardown(fx);
+	return fails ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	CHECK_EQ(pcnet_init(), 0);
+	if (argc > 1 && !strcmp(argv[1], "--bench"))
+		return run_bench();
+	return run_tests();
+}